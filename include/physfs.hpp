@@ -2,12 +2,29 @@
 #define _INCLUDE_PHYSFS_HPP_
 
 #include <physfs.h>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
+// Define PHYSFSPP_NO_EXCEPTIONS (CMake option of the same name) to build with
+// -fno-exceptions. Anything that would throw then prints its message and
+// aborts, so such builds should use the try* functions and the streams'
+// open() factories, which report failures through Result.
+#ifdef PHYSFSPP_NO_EXCEPTIONS
+#define PHYSFSPP_THROW(exception) ::PhysFS::abortWith((exception).what())
+#else
+#define PHYSFSPP_THROW(exception) throw exception
+#endif
+
 namespace PhysFS {
 
+[[noreturn]] void abortWith(char const * message);
+
 typedef enum {
 	READ,
 	WRITE,
@@ -48,9 +65,130 @@ typedef std::vector<ArchiveInfo> ArchiveInfoList;
 
 typedef uint64 size_t;
 
+class Compress {
+public:
+	typedef enum {
+		NONE,
+		ZSTD,
+		LZ4
+	} codec;
+
+	static Compress none();
+	static Compress zstd(int level = 3);
+	static Compress lz4(int acceleration = 1);
+	static bool isAvailable(codec method);
+
+	// number of frames decompressed concurrently when reading; above 1, that
+	// many threads live as long as the stream and decode the next frames
+	// while the current ones are being read
+	Compress & threads(unsigned count);
+	// uncompressed bytes per independently compressed frame when writing,
+	// through ofstream or compressFilter; the last frame may be shorter
+	Compress & frameSize(std::size_t bytes);
+
+	codec getMethod() const;
+	int getLevel() const;
+	unsigned getThreads() const;
+	std::size_t getFrameSize() const;
+private:
+	Compress(codec method, int level);
+
+	codec method;
+	int level;
+	unsigned threadCount;
+	std::size_t frameBytes;
+};
+
+class Filter;
+
+// Why a call failed. PhysFS 2.0 reports errors only as text, so this holds
+// what PHYSFS_getLastError() said at the time.
+class Error {
+public:
+	Error();
+	explicit Error(string const & message);
+
+	string const & getMessage() const;
+private:
+	string message;
+};
+
+// Either a value or the Error that prevented it.
+template <typename T>
+class Result {
+public:
+	Result(T value) : stored(std::move(value)) {}
+	Result(Error const & error) : failure(error) {}
+
+	bool ok() const {
+		return stored.has_value();
+	}
+
+	explicit operator bool() const {
+		return ok();
+	}
+
+	// throws std::logic_error (aborts without exceptions) if there is none
+	T & value() {
+		check();
+		return *stored;
+	}
+
+	T const & value() const {
+		check();
+		return *stored;
+	}
+
+	T & operator*() {
+		return value();
+	}
+
+	T * operator->() {
+		return &value();
+	}
+
+	Error const & error() const {
+		return failure;
+	}
+private:
+	void check() const {
+		if (!ok()) {
+			PHYSFSPP_THROW(std::logic_error("no value: " + failure.getMessage()));
+		}
+	}
+
+	std::optional<T> stored;
+	Error failure;
+};
+
+template <>
+class Result<void> {
+public:
+	Result() : succeeded(true) {}
+	Result(Error const & error) : succeeded(false), failure(error) {}
+
+	bool ok() const {
+		return succeeded;
+	}
+
+	explicit operator bool() const {
+		return ok();
+	}
+
+	Error const & error() const {
+		return failure;
+	}
+private:
+	bool succeeded;
+	Error failure;
+};
+
 class base_fstream {
 protected:
 	PHYSFS_File * const file;
+
+	// throws std::invalid_argument if the file cannot be opened
+	base_fstream(string const & filename, mode openMode);
 public:
 	base_fstream(PHYSFS_File * file);
 	virtual ~base_fstream();
@@ -58,21 +196,59 @@ public:
 };
 
 class ifstream : public base_fstream, public std::istream {
+private:
+	ifstream(PHYSFS_File * file, string const & filename);
 public:
 	ifstream(string const & filename);
+	// a corrupt or truncated file sets badbit where it goes wrong; builds
+	// without exceptions just see the end of the file there
+	ifstream(string const & filename, Compress const & compression);
+	ifstream(string const & filename, std::unique_ptr<Filter> filter);
 	virtual ~ifstream();
+
+	static Result<std::unique_ptr<ifstream> > open(string const & filename);
+
+	// Bytes already buffered, valid until the next read, seek or peek.
+	// Refills only when nothing is buffered; empty at end of file.
+	std::string_view contiguous();
+	// At least count bytes (fewer only at end of file), refilling as needed.
+	std::string_view peek(std::size_t count);
+	using std::istream::peek;
+	void consume(std::size_t count);
+	// bytes left to read, or -1 for compressed and filtered streams
+	sint64 remaining();
 };
 
 class ofstream : public base_fstream, public std::ostream {
+private:
+	explicit ofstream(PHYSFS_File * file);
 public:
 	ofstream(string const & filename, mode writeMode = WRITE);
+	ofstream(string const & filename, mode writeMode, Compress const & compression);
+	ofstream(string const & filename, mode writeMode, std::unique_ptr<Filter> filter);
 	virtual ~ofstream();
+
+	static Result<std::unique_ptr<ofstream> > open(string const & filename, mode writeMode = WRITE);
 };
 
 class fstream : public base_fstream, public std::iostream {
+private:
+	explicit fstream(PHYSFS_File * file);
 public:
 	fstream(string const & filename, mode openMode = READ);
 	virtual ~fstream();
+
+	static Result<std::unique_ptr<fstream> > open(string const & filename, mode openMode = READ);
+
+	// Bytes already buffered, valid until the next read, seek or peek.
+	// Refills only when nothing is buffered; empty at end of file.
+	std::string_view contiguous();
+	// At least count bytes (fewer only at end of file), refilling as needed.
+	std::string_view peek(std::size_t count);
+	using std::istream::peek;
+	void consume(std::size_t count);
+	// bytes left to read, or -1 for compressed and filtered streams
+	sint64 remaining();
 };
 
 Version getLinkedVersion();
@@ -135,6 +311,57 @@ void mount(string const & newDir, string const & mountPoint, bool appendToPath);
 
 string getMountPoint(string const & dir);
 
+// Views of the strings PhysFS owns, without copying them; "" where the
+// string version would have none. getDirSeparatorView() is valid forever,
+// getBaseDirView() and getUserDirView() until deinit, getWriteDirView() until
+// the write dir changes, and getRealDirView() and getMountPointView() until
+// that directory leaves the search path.
+std::string_view getDirSeparatorView();
+
+std::string_view getBaseDirView();
+
+std::string_view getUserDirView();
+
+std::string_view getWriteDirView();
+
+std::string_view getRealDirView(string const & filename);
+
+std::string_view getMountPointView(string const & dir);
+
+// Copies of the configuration directories, taken again only when init,
+// deinit, setWriteDir or setSaneConfig (or their try* forms) run. A snapshot
+// stays valid for as long as it is held, whatever happens afterwards.
+struct ConfigDirs {
+	string baseDir;
+	string userDir;
+	string writeDir;
+	string dirSeparator;
+};
+
+std::shared_ptr<ConfigDirs const> getConfigDirs();
+
+// The calls further up that can fail, reporting the failure instead of
+// ignoring it.
+Result<void> tryInit(char const * argv0);
+
+Result<void> tryDeinit();
+
+Result<void> trySetWriteDir(string const & newDir);
+
+Result<void> tryRemoveFromSearchPath(string const & oldDir);
+
+Result<void> trySetSaneConfig(string const & orgName, string const & appName, string const & archiveExt, bool includeCdRoms, bool archivesFirst);
+
+Result<void> tryMkdir(string const & dirName);
+
+Result<void> tryDeleteFile(string const & filename);
+
+Result<void> tryMount(string const & newDir, string const & mountPoint, bool appendToPath);
+
+Result<string> tryGetRealDir(string const & filename);
+
+Result<string> tryGetMountPoint(string const & dir);
+
 namespace Util {
 
 sint16 swapSLE16(sint16 value);
@@ -0,0 +1,272 @@
+#ifndef _INCLUDE_PHYSFS_ASSET_HPP_
+#define _INCLUDE_PHYSFS_ASSET_HPP_
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// Relocatable assets: plain structs laid out in a file exactly as they are
+// in memory, linked by offsets relative to where each link is stored, so a
+// file can be used wherever it is loaded or mapped without being parsed.
+// Every type stored must be trivially copyable and aligned to at most
+// assetAlignment. Only the header is checked when a file is opened; the
+// rest is trusted, as it came from an AssetBuilder.
+
+std::size_t const assetAlignment = 16;
+
+// A link to a T stored elsewhere in the same asset. It is only meaningful
+// where the builder put it, so use it in place and never copy it out.
+template <typename T>
+class Offset {
+private:
+	friend class AssetBuilder;
+
+	// from this object to the target; 0 for none
+	sint64 distance;
+public:
+	bool isNull() const {
+		return distance == 0;
+	}
+
+	T const * get() const {
+		return isNull() ? NULL : reinterpret_cast<T const *>(reinterpret_cast<char const *>(this) + distance);
+	}
+
+	T const & operator*() const {
+		return *get();
+	}
+
+	T const * operator->() const {
+		return get();
+	}
+};
+
+// count Ts stored one after another
+template <typename T>
+class Array {
+private:
+	friend class AssetBuilder;
+
+	Offset<T> first;
+	uint64 count;
+public:
+	typedef T const * const_iterator;
+
+	std::size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	T const * data() const {
+		return first.get();
+	}
+
+	T const & operator[](std::size_t index) const {
+		return data()[index];
+	}
+
+	const_iterator begin() const {
+		return data();
+	}
+
+	const_iterator end() const {
+		return data() + count;
+	}
+};
+
+// Text in the asset's string table, followed by a '\0'.
+class AssetString {
+private:
+	friend class AssetBuilder;
+
+	Offset<char> first;
+	uint64 length;
+public:
+	std::string_view view() const {
+		return std::string_view(first.get(), length);
+	}
+
+	char const * c_str() const {
+		return first.get();
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+};
+
+struct AssetHeader {
+	char magic[8];
+	uint32 version;
+	// 0x01020304 as the writer stored it, which catches the wrong byte order
+	uint32 byteOrder;
+	// of the whole asset, header included
+	uint64 size;
+	uint64 root;
+	// sizeof the root type, checked when it is asked for
+	uint64 rootSize;
+	uint64 reserved;
+};
+
+// the header, after checking it describes an asset of bytes.size() bytes
+// starting at an assetAlignment boundary; throws std::runtime_error if not
+AssetHeader const & validateAsset(std::string_view bytes);
+
+// The root object of an asset held in bytes. Throws std::runtime_error if
+// the header is not valid, and std::invalid_argument if the root was
+// written as a type of another size.
+template <typename T>
+T const & assetRoot(std::string_view bytes) {
+	AssetHeader const & header = validateAsset(bytes);
+	if (header.rootSize != sizeof(T)) {
+		PHYSFSPP_THROW(std::invalid_argument("asset root is not of the requested type"));
+	}
+	return *reinterpret_cast<T const *>(bytes.data() + header.root);
+}
+
+// Lays out an asset. Leaves are usually added first and linked from the
+// objects added after them, though link() works in either order. Where
+// means a byte offset in the asset; it stays valid as the asset grows,
+// unlike any pointer into it.
+class AssetBuilder {
+private:
+	AssetBuilder(const AssetBuilder & other);
+	AssetBuilder& operator=(const AssetBuilder& other);
+
+	std::vector<char> bytes;
+	std::map<string, uint64> strings;
+	uint64 root;
+	uint64 rootSize;
+
+	uint64 reserve(std::size_t size, std::size_t alignment);
+
+	template <typename T>
+	static void checkStorable() {
+		static_assert(std::is_trivially_copyable<T>::value, "assets can only hold trivially copyable types");
+		static_assert(alignof(T) <= assetAlignment, "asset types must be aligned to at most assetAlignment");
+	}
+
+	template <typename S, typename Field>
+	Field & field(uint64 object, Field S::*member, uint64 & where) {
+		S * placed = reinterpret_cast<S *>(bytes.data() + object);
+		Field & found = placed->*member;
+		where = reinterpret_cast<char *>(&found) - bytes.data();
+		return found;
+	}
+
+	template <typename T>
+	void point(Offset<T> & link, uint64 where, uint64 target) {
+		link.distance = (sint64) target - (sint64) where;
+	}
+public:
+	AssetBuilder();
+
+	// a copy of value
+	template <typename T>
+	uint64 add(T const & value) {
+		checkStorable<T>();
+		uint64 where = reserve(sizeof(T), alignof(T));
+		memcpy(bytes.data() + where, &value, sizeof(T));
+		return where;
+	}
+
+	// copies of count items, one after another, for linking as an Array
+	template <typename T>
+	uint64 addArray(T const * items, std::size_t count) {
+		checkStorable<T>();
+		uint64 where = reserve(sizeof(T) * count, alignof(T));
+		if (count > 0) {
+			memcpy(bytes.data() + where, items, sizeof(T) * count);
+		}
+		return where;
+	}
+
+	// text in the string table, stored once however often it is added
+	uint64 addString(std::string_view text);
+
+	// makes object's member point at the T at target
+	template <typename S, typename T>
+	void link(uint64 object, Offset<T> S::*member, uint64 target) {
+		uint64 where;
+		Offset<T> & found = field(object, member, where);
+		point(found, where, target);
+	}
+
+	// makes object's member the count items added at first
+	template <typename S, typename T>
+	void link(uint64 object, Array<T> S::*member, uint64 first, std::size_t count) {
+		uint64 where;
+		Array<T> & found = field(object, member, where);
+		point(found.first, where, first);
+		found.count = count;
+	}
+
+	// makes object's member hold text, adding it to the string table
+	template <typename S>
+	void link(uint64 object, AssetString S::*member, std::string_view text) {
+		uint64 target = addString(text);
+		uint64 where;
+		AssetString & found = field(object, member, where);
+		point(found.first, where, target);
+		found.length = text.size();
+	}
+
+	// the object assetRoot() and AssetFile::root() will return
+	template <typename T>
+	void setRoot(uint64 object) {
+		root = object;
+		rootSize = sizeof(T);
+	}
+
+	// the finished asset; the builder can keep growing it afterwards
+	std::vector<char> const & finish();
+
+	// the finished asset, written to filename in the write dir; throws
+	// std::invalid_argument if it cannot be opened and std::runtime_error if
+	// writing fails
+	void write(string const & filename);
+};
+
+// An asset file made available in place: mapped straight from a native
+// directory when possible, otherwise read whole into aligned memory.
+class AssetFile {
+public:
+	typedef enum {
+		MAPPED,
+		LOADED
+	} backing;
+private:
+	AssetFile(const AssetFile & other);
+	AssetFile& operator=(const AssetFile& other);
+
+	class Storage;
+	std::unique_ptr<Storage> storage;
+public:
+	// Throws std::invalid_argument if filename cannot be opened and
+	// std::runtime_error if it cannot be read or is not a valid asset.
+	// LOADED skips mapping even where it would work.
+	explicit AssetFile(string const & filename, backing preferred = MAPPED);
+	~AssetFile();
+
+	backing getBacking() const;
+	std::string_view bytes() const;
+
+	template <typename T>
+	T const & root() const {
+		return assetRoot<T>(bytes());
+	}
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_ASSET_HPP_ */
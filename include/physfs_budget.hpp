@@ -0,0 +1,83 @@
+#ifndef _INCLUDE_PHYSFS_BUDGET_HPP_
+#define _INCLUDE_PHYSFS_BUDGET_HPP_
+
+#include <functional>
+#include <memory>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// bytes a cache holds that it could give back
+typedef std::function<std::size_t()> UsageFunction;
+
+// asked to hold at most target bytes; returns the bytes released
+typedef std::function<std::size_t(std::size_t target)> ShrinkFunction;
+
+class PressureOptions {
+public:
+	PressureOptions();
+
+	// how often the pressure sources are read
+	PressureOptions & interval(unsigned milliseconds);
+	// trim once PSI "some avg10" for memory passes this percentage
+	PressureOptions & stallPercent(double percent);
+	// trim once the cgroup uses this fraction of memory.high, or memory.max
+	// when there is no high limit
+	PressureOptions & cgroupFraction(double fraction);
+	// under pressure, trim the caches to this fraction of their usage
+	PressureOptions & keepFraction(double fraction);
+
+	unsigned getInterval() const;
+	double getStallPercent() const;
+	double getCgroupFraction() const;
+	double getKeepFraction() const;
+private:
+	unsigned milliseconds;
+	double stall;
+	double cgroup;
+	double keep;
+};
+
+// Caches that can give memory back, trimmed together. Each cache registers
+// with a cost per byte of getting its contents back; trim() shrinks the
+// cheapest first and stops as soon as the target is met. The library's own
+// caches register with global(): the pooled stream buffers, the directories
+// mkdirs has seen, and each MemoryWriteDir, whose pending files are flushed.
+// Usage and shrink functions are called without the budget locked, so they
+// may run just after their cache is removed; capture what they need by
+// value or shared_ptr.
+class MemoryBudget {
+private:
+	MemoryBudget(const MemoryBudget & other);
+	MemoryBudget& operator=(const MemoryBudget& other);
+
+	class State;
+	std::shared_ptr<State> state;
+public:
+	MemoryBudget();
+	// stops watching
+	~MemoryBudget();
+
+	static MemoryBudget & global();
+
+	// returns an id for remove()
+	uint64 add(double cost, UsageFunction const & usage, ShrinkFunction const & shrink);
+	void remove(uint64 id);
+
+	// total over every cache
+	std::size_t usage() const;
+
+	// shrinks caches, cheapest first, until they hold at most targetBytes
+	// between them; returns the bytes released
+	std::size_t trim(std::size_t targetBytes);
+
+	// Trims from a background thread whenever Linux reports memory pressure,
+	// through /proc/pressure/memory or the process's cgroup v2 memory files.
+	// Returns false, without watching, where neither can be read.
+	bool watchPressure(PressureOptions const & options = PressureOptions());
+	void stopWatching();
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_BUDGET_HPP_ */
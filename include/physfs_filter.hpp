@@ -0,0 +1,202 @@
+#ifndef _INCLUDE_PHYSFS_FILTER_HPP_
+#define _INCLUDE_PHYSFS_FILTER_HPP_
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <string.h>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// An owned block of bytes handed from stage to stage. Stages either modify it
+// in place, trim it, or pass it on; the bytes themselves are never copied.
+class Chunk {
+private:
+	Chunk(const Chunk & other);
+	Chunk& operator=(const Chunk& other);
+
+	std::unique_ptr<char[]> storage;
+	std::size_t offset;
+	std::size_t length;
+	std::size_t bytes;
+public:
+	Chunk() : offset(0), length(0), bytes(0) {}
+
+	explicit Chunk(std::size_t capacity)
+		: storage(new char[capacity]), offset(0), length(0), bytes(capacity) {}
+
+	Chunk(Chunk && other)
+		: storage(std::move(other.storage)), offset(other.offset), length(other.length), bytes(other.bytes) {
+		other.offset = other.length = other.bytes = 0;
+	}
+
+	Chunk & operator=(Chunk && other) {
+		storage = std::move(other.storage);
+		offset = other.offset;
+		length = other.length;
+		bytes = other.bytes;
+		other.offset = other.length = other.bytes = 0;
+		return *this;
+	}
+
+	char * data() {
+		return storage.get() + offset;
+	}
+
+	char const * data() const {
+		return storage.get() + offset;
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+
+	bool empty() const {
+		return length == 0;
+	}
+
+	// bytes available from data() without reallocating
+	std::size_t capacity() const {
+		return bytes - offset;
+	}
+
+	void resize(std::size_t size) {
+		reserve(size);
+		length = size;
+	}
+
+	void reserve(std::size_t size) {
+		if (size <= capacity()) {
+			return;
+		}
+		std::unique_ptr<char[]> grown(new char[size]);
+		memcpy(grown.get(), data(), length);
+		storage = std::move(grown);
+		offset = 0;
+		bytes = size;
+	}
+
+	// drops bytes from the front, e.g. a header a stage has parsed
+	void consume(std::size_t count) {
+		if (count > length) {
+			count = length;
+		}
+		offset += count;
+		length -= count;
+	}
+};
+
+class ChunkSink {
+public:
+	virtual ~ChunkSink() {}
+	virtual void push(Chunk && chunk) = 0;
+	virtual void finish() {}
+};
+
+// Runtime filter stage. push may forward any number of chunks to next;
+// finish flushes whatever the stage still holds when the stream ends; the
+// stream then calls finish on its own sink.
+class Filter {
+public:
+	virtual ~Filter() {}
+	virtual void push(Chunk && chunk, ChunkSink & next) = 0;
+	virtual void finish(ChunkSink &) {}
+};
+
+// Stages chained at runtime, e.g. when the set of stages comes from config.
+class FilterChain : public Filter {
+private:
+	class link : public ChunkSink {
+	public:
+		link(FilterChain const * chain, std::size_t index, ChunkSink * next)
+			: chain(chain), index(index), next(next) {}
+		void push(Chunk && chunk);
+	private:
+		FilterChain const * chain;
+		std::size_t index;
+		ChunkSink * next;
+	};
+
+	std::vector<std::unique_ptr<Filter> > stages;
+public:
+	FilterChain & add(std::unique_ptr<Filter> stage) {
+		stages.push_back(std::move(stage));
+		return *this;
+	}
+
+	void push(Chunk && chunk, ChunkSink & next);
+	void finish(ChunkSink & next);
+};
+
+// Stages chained at compile time. A stage is any default-constructible type
+// with template <class Next> push(Chunk &&, Next &) and finish(Next &); calls
+// between stages are direct and can be inlined. A Pipeline is itself a stage.
+template <class... Stages>
+class Pipeline;
+
+template <>
+class Pipeline<> {
+public:
+	template <class Next>
+	void push(Chunk && chunk, Next & next) {
+		next.push(std::move(chunk));
+	}
+
+	template <class Next>
+	void finish(Next &) {}
+};
+
+template <class Head, class... Tail>
+class Pipeline<Head, Tail...> {
+private:
+	template <class Next>
+	struct link {
+		Pipeline<Tail...> & rest;
+		Next & next;
+		void push(Chunk && chunk) {
+			rest.push(std::move(chunk), next);
+		}
+	};
+public:
+	Head head;
+	Pipeline<Tail...> tail;
+
+	template <class Next>
+	void push(Chunk && chunk, Next & next) {
+		link<Next> to = { tail, next };
+		head.push(std::move(chunk), to);
+	}
+
+	template <class Next>
+	void finish(Next & next) {
+		link<Next> to = { tail, next };
+		head.finish(to);
+		tail.finish(next);
+	}
+};
+
+// Wraps a compile-time stage (or Pipeline) so streams can take it.
+template <class Stage>
+class StaticFilter : public Filter {
+public:
+	Stage stage;
+
+	void push(Chunk && chunk, ChunkSink & next) {
+		stage.push(std::move(chunk), next);
+	}
+
+	void finish(ChunkSink & next) {
+		stage.finish(next);
+	}
+};
+
+std::unique_ptr<Filter> compressFilter(Compress const & compression);
+
+// Reads what compressFilter or a compressing ofstream wrote. A corrupt or
+// truncated stream sets badbit on the istream reading it.
+std::unique_ptr<Filter> decompressFilter();
+
+}
+
+#endif /* _INCLUDE_PHYSFS_FILTER_HPP_ */
@@ -0,0 +1,65 @@
+#ifndef _INCLUDE_PHYSFS_HASH_HPP_
+#define _INCLUDE_PHYSFS_HASH_HPP_
+
+#include "physfs.hpp"
+#include "physfs_filter.hpp"
+
+namespace PhysFS {
+
+typedef enum {
+	CRC32,
+	CRC32C,
+	XXH64
+} hashAlgorithm;
+
+// Incremental hash. CRC32 and CRC32C use PCLMUL and SSE4.2 when the CPU
+// has them and fall back to table lookups otherwise.
+class Hasher {
+public:
+	explicit Hasher(hashAlgorithm algorithm, uint64 seed = 0);
+	void update(void const * data, std::size_t size);
+	uint64 digest() const;
+	void reset();
+	hashAlgorithm getAlgorithm() const;
+private:
+	hashAlgorithm algorithm;
+	uint64 seed;
+	uint64 state[4];
+	uint64 totalLength;
+	unsigned char tail[32];
+	std::size_t tailSize;
+};
+
+// Passes chunks through unchanged while feeding them to hasher, so a file
+// can be hashed while it is being read.
+class HashFilter : public Filter {
+public:
+	explicit HashFilter(Hasher & hasher) : hasher(hasher) {}
+
+	void push(Chunk && chunk, ChunkSink & next) {
+		hasher.update(chunk.data(), chunk.size());
+		next.push(std::move(chunk));
+	}
+private:
+	Hasher & hasher;
+};
+
+struct FileHash {
+	string path;
+	uint64 hash;
+};
+
+typedef std::vector<FileHash> FileHashList;
+
+// throws std::invalid_argument if filename cannot be opened and
+// std::runtime_error if reading it fails, rather than return a digest of
+// part of it
+uint64 hashFile(string const & filename, hashAlgorithm algorithm);
+
+// hashes every file below root using threads workers (0 = one per core),
+// returned sorted by path; throws as hashFile does
+FileHashList hashTree(string const & root, hashAlgorithm algorithm, unsigned threads = 0);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_HASH_HPP_ */
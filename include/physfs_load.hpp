@@ -0,0 +1,101 @@
+#ifndef _INCLUDE_PHYSFS_LOAD_HPP_
+#define _INCLUDE_PHYSFS_LOAD_HPP_
+
+#include <string_view>
+#include <vector>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// Where Buffers get their memory. allocate must return memory aligned to
+// alignment, which is always a power of two.
+class BufferAllocator {
+public:
+	virtual ~BufferAllocator() {}
+	virtual void * allocate(std::size_t size, std::size_t alignment) = 0;
+	virtual void deallocate(void * memory, std::size_t size, std::size_t alignment) = 0;
+};
+
+// aligned operator new
+BufferAllocator & defaultAllocator();
+
+class ReadOptions {
+public:
+	ReadOptions();
+
+	// power of two that data() will be a multiple of
+	ReadOptions & alignment(std::size_t bytes);
+	// zeroed bytes after the data that may be read, e.g. by SIMD loads
+	ReadOptions & padding(std::size_t bytes);
+	// must outlive every Buffer it allocates
+	ReadOptions & allocator(BufferAllocator & source);
+
+	std::size_t getAlignment() const;
+	std::size_t getPadding() const;
+	BufferAllocator & getAllocator() const;
+private:
+	std::size_t alignmentBytes;
+	std::size_t paddingBytes;
+	BufferAllocator * source;
+};
+
+// Memory from a BufferAllocator holding size() bytes followed by padding()
+// zeroed ones.
+class Buffer {
+private:
+	Buffer(const Buffer & other);
+	Buffer& operator=(const Buffer& other);
+
+	void release();
+
+	char * memory;
+	std::size_t length;
+	std::size_t capacity;
+	std::size_t alignment;
+	BufferAllocator * source;
+public:
+	Buffer();
+	Buffer(std::size_t size, ReadOptions const & options);
+	Buffer(Buffer && other);
+	Buffer& operator=(Buffer && other);
+	~Buffer();
+
+	char * data();
+	char const * data() const;
+	std::size_t size() const;
+	std::size_t padding() const;
+	bool empty() const;
+	std::string_view view() const;
+
+	// drops bytes past size, which grow the zeroed padding
+	void truncate(std::size_t size);
+};
+
+// The whole file read straight into the buffer, with no intermediate copy.
+// Throws std::invalid_argument if it cannot be opened and std::runtime_error
+// if reading fails.
+Buffer readAll(string const & filename, ReadOptions const & options = ReadOptions());
+
+// Up to length bytes starting at offset; shorter at the end of the file.
+Buffer readRange(string const & filename, uint64 offset, std::size_t length, ReadOptions const & options = ReadOptions());
+
+struct LoadedFile {
+	string path;
+	std::string_view contents;
+};
+
+// Files that share one arena. Moving it keeps every view valid.
+struct LoadedFiles {
+	Buffer arena;
+	std::vector<LoadedFile> files;
+};
+
+// Reads many small files into one allocation: every file is sized first,
+// then read into its own slot by up to threads workers (0 = one per core).
+// Each slot starts on the options' alignment and is followed by at least its
+// padding in zeroes. files is in the order of paths. Throws like readAll.
+LoadedFiles loadManyContiguous(StringList const & paths, ReadOptions const & options = ReadOptions(), unsigned threads = 0);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_LOAD_HPP_ */
@@ -0,0 +1,52 @@
+#ifndef _INCLUDE_PHYSFS_MEMDIR_HPP_
+#define _INCLUDE_PHYSFS_MEMDIR_HPP_
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// Holds writes to the write dir in memory and applies them to the real
+// write dir later, in one batch: from a background thread every
+// flushIntervalMilliseconds (0 = never on a timer), as soon as more than
+// memoryLimit bytes are pending, when flush() is called and on destruction.
+// A file is only published, and so visible to reads and flushes, once the
+// stream writing it is destroyed; flushing that stream does not publish it.
+// Until then its bytes are not counted by pendingBytes() or memoryLimit. A
+// stream that outlives its MemoryWriteDir writes its file out as soon as it
+// is destroyed. If a flush fails, the failed operations, deletes included,
+// stay pending and are retried next time. Pending files are also flushed
+// when MemoryBudget::global() is trimmed.
+class MemoryWriteDir {
+private:
+	MemoryWriteDir(const MemoryWriteDir & other);
+	MemoryWriteDir& operator=(const MemoryWriteDir& other);
+
+	class State;
+	std::shared_ptr<State> state;
+	uint64 budgetId;
+public:
+	explicit MemoryWriteDir(std::size_t memoryLimit = 64 * 1024 * 1024, unsigned flushIntervalMilliseconds = 1000);
+	~MemoryWriteDir();
+
+	bool mkdir(string const & dirName);
+	bool deleteFile(string const & filename);
+	// WRITE or APPEND; APPEND starts from the pending or existing contents
+	std::unique_ptr<std::ostream> openWrite(string const & filename, mode writeMode = WRITE);
+
+	// pending contents if there are any, otherwise the file on the search
+	// path, as ifstream would; throws std::invalid_argument if there is
+	// neither or the file has been deleted
+	std::unique_ptr<std::istream> openRead(string const & filename);
+	bool exists(string const & filename) const;
+
+	// applies everything pending now; false if anything failed
+	bool flush();
+	std::size_t pendingBytes() const;
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_MEMDIR_HPP_ */
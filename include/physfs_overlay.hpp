@@ -0,0 +1,45 @@
+#ifndef _INCLUDE_PHYSFS_OVERLAY_HPP_
+#define _INCLUDE_PHYSFS_OVERLAY_HPP_
+
+#include <istream>
+#include <memory>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// Copy-on-write editing of files on the search path, archives included.
+// A file opened for update gets a shadow in the write dir, below
+// shadowRoot/<path>.chunks/, that holds only the chunks that were written
+// plus the file's length; everything else is still read from the search
+// path. Files with a shadow are read through it by openRead. The write dir
+// must be a native directory.
+class Overlay {
+public:
+	explicit Overlay(string const & shadowRoot = ".overlay", std::size_t chunkSize = 64 * 1024);
+
+	// Reads and writes anywhere in path. Chunks are copied into the shadow
+	// only when first written, and saved when the stream moves on to another
+	// chunk, flushes or is destroyed. path need not exist yet. A failed save
+	// sets badbit on the stream; flush it before destruction to catch one.
+	std::unique_ptr<std::iostream> openUpdate(string const & path) const;
+
+	// throws std::invalid_argument if path has neither shadow nor original
+	std::unique_ptr<std::istream> openRead(string const & path) const;
+
+	bool isShadowed(string const & path) const;
+
+	// deletes the shadow, so path reads as the original again
+	void discard(string const & path) const;
+
+	string const & getShadowRoot() const;
+	std::size_t getChunkSize() const;
+private:
+	string shadowDir(string const & path) const;
+
+	string shadowRoot;
+	std::size_t chunkSize;
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_OVERLAY_HPP_ */
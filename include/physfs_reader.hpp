@@ -0,0 +1,135 @@
+#ifndef _INCLUDE_PHYSFS_READER_HPP_
+#define _INCLUDE_PHYSFS_READER_HPP_
+
+#include <istream>
+#include <stdexcept>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+class peekbuf;
+
+// Splits a stream into lines without copying them out of its buffer. Lines
+// exclude the '\n', as with std::getline, and stay valid until the next call
+// to next(). Only a line that straddles a refill is copied. The stream is
+// always positioned just after the last line returned.
+class LineReader {
+private:
+	LineReader(const LineReader & other);
+	LineReader& operator=(const LineReader& other);
+
+	peekbuf * buffer;
+	string carry;
+	uint64 number;
+public:
+	// throw std::invalid_argument if the stream's rdbuf() has been replaced
+	explicit LineReader(ifstream & stream);
+	explicit LineReader(fstream & stream);
+
+	// false once the stream is exhausted
+	bool next(std::string_view & line);
+
+	// 1-based number of the line next() last returned, 0 before the first
+	uint64 lineNumber() const;
+};
+
+typedef enum {
+	LITTLE_ENDIAN_ORDER,
+	BIG_ENDIAN_ORDER
+} byteOrder;
+
+// Reads records stored as a LengthType byte count followed by that many
+// bytes. Records are returned as views into one large buffer that is filled
+// with as few reads as possible; only the part of a record that straddles a
+// refill is moved, to the front of the buffer. A record is valid until the
+// next call to next().
+template <typename LengthType, byteOrder Order = LITTLE_ENDIAN_ORDER>
+class RecordReader {
+private:
+	static_assert(std::is_integral<LengthType>::value && std::is_unsigned<LengthType>::value,
+		"record lengths must be unsigned integers");
+
+	RecordReader(const RecordReader & other);
+	RecordReader& operator=(const RecordReader& other);
+
+	static std::size_t const maxRecordSize = std::size_t(1) << 30;
+
+	std::streambuf * const source;
+	std::vector<char> buffer;
+	std::size_t begin;
+	std::size_t end;
+	uint64 number;
+
+	// makes at least count bytes available from begin; false if the stream
+	// ends first
+	bool fill(std::size_t count) {
+		if (end - begin >= count) {
+			return true;
+		}
+		if (begin > 0) {
+			memmove(buffer.data(), buffer.data() + begin, end - begin);
+			end -= begin;
+			begin = 0;
+		}
+		if (count > buffer.size()) {
+			buffer.resize(count > buffer.size() * 2 ? count : buffer.size() * 2);
+		}
+		while (end < count) {
+			std::streamsize bytesRead = source->sgetn(buffer.data() + end, buffer.size() - end);
+			if (bytesRead < 1) {
+				return false;
+			}
+			end += bytesRead;
+		}
+		return true;
+	}
+
+	LengthType decodeLength() const {
+		unsigned char const * bytes = (unsigned char const *) buffer.data() + begin;
+		LengthType length = 0;
+		for (std::size_t i = 0; i < sizeof(LengthType); i++) {
+			std::size_t shift = Order == LITTLE_ENDIAN_ORDER ? i : sizeof(LengthType) - 1 - i;
+			length |= LengthType(bytes[i]) << (8 * shift);
+		}
+		return length;
+	}
+public:
+	explicit RecordReader(std::istream & stream, std::size_t bufferSize = 256 * 1024)
+		: source(stream.rdbuf()), buffer(bufferSize > sizeof(LengthType) ? bufferSize : sizeof(LengthType)),
+		  begin(0), end(0), number(0) {}
+
+	// false at a clean end of stream; throws std::runtime_error if the stream
+	// ends inside a record or a length is implausibly large
+	bool next(std::string_view & record) {
+		if (!fill(sizeof(LengthType))) {
+			if (begin == end) {
+				return false;
+			}
+			PHYSFSPP_THROW(std::runtime_error("truncated record length"));
+		}
+		uint64 length = decodeLength();
+		if (length > maxRecordSize) {
+			PHYSFSPP_THROW(std::runtime_error("record too large"));
+		}
+		if (!fill(sizeof(LengthType) + length)) {
+			PHYSFSPP_THROW(std::runtime_error("truncated record"));
+		}
+		record = std::string_view(buffer.data() + begin + sizeof(LengthType), length);
+		begin += sizeof(LengthType) + length;
+		number++;
+		return true;
+	}
+
+	// 1-based number of the record next() last returned, 0 before the first
+	uint64 recordNumber() const {
+		return number;
+	}
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_READER_HPP_ */
@@ -0,0 +1,64 @@
+#ifndef _INCLUDE_PHYSFS_REGISTRY_HPP_
+#define _INCLUDE_PHYSFS_REGISTRY_HPP_
+
+#include <memory>
+#include "physfs.hpp"
+#include "physfs_watch.hpp"
+
+namespace PhysFS {
+
+typedef std::shared_ptr<string const> Content;
+
+// A counted reference to a loaded file. get() never blocks: a reload swaps
+// in a new Content, and readers still holding the old one keep it alive.
+class Resource {
+public:
+	Resource();
+
+	Content get() const;
+	string const & getPath() const;
+	bool isLoaded() const;
+private:
+	friend class Registry;
+
+	struct slot {
+		string path;
+		Content content;
+	};
+
+	explicit Resource(std::shared_ptr<slot> const & loaded);
+
+	std::shared_ptr<slot> loaded;
+};
+
+// Maps virtual paths to shared, immutable contents. Each file is read once
+// however many threads ask for it at the same time, and it is forgotten
+// once the last Resource for it is gone. Feed Watcher events to onChange
+// to reload files as they change.
+class Registry {
+private:
+	Registry(const Registry & other);
+	Registry& operator=(const Registry& other);
+
+	class State;
+	std::shared_ptr<State> state;
+public:
+	Registry();
+	~Registry();
+
+	// throws std::invalid_argument if the file cannot be opened or read
+	Resource load(string const & path);
+
+	// rereads path if it is loaded; returns false if it is not or the read
+	// failed, in which case the old contents stay in place
+	bool reload(string const & path);
+
+	void onChange(ChangeList const & changes);
+
+	// number of files currently loaded
+	std::size_t size() const;
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_REGISTRY_HPP_ */
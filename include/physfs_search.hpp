@@ -0,0 +1,62 @@
+#ifndef _INCLUDE_PHYSFS_SEARCH_HPP_
+#define _INCLUDE_PHYSFS_SEARCH_HPP_
+
+#include <functional>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+struct SearchMatch {
+	string path;
+	// of the first byte of the match
+	uint64 offset;
+	// index of the pattern that matched, always 0 for a single pattern
+	std::size_t pattern;
+};
+
+// Called for each match; calls are serialized but may come from worker
+// threads. Returning false stops the search.
+typedef std::function<bool(SearchMatch const &)> MatchCallback;
+
+class SearchOptions {
+public:
+	SearchOptions();
+
+	// workers reading and matching files (0 = one per core)
+	SearchOptions & threads(unsigned count);
+	// bytes read from a file at a time
+	SearchOptions & blockSize(std::size_t bytes);
+	// ASCII letters match either case
+	SearchOptions & ignoreCase(bool ignore);
+	// report only the first match in each file, as grep -l would
+	SearchOptions & firstMatchOnly(bool first);
+
+	unsigned getThreads() const;
+	std::size_t getBlockSize() const;
+	bool getIgnoreCase() const;
+	bool getFirstMatchOnly() const;
+private:
+	unsigned threadCount;
+	std::size_t blockBytes;
+	bool ignoring;
+	bool firstOnly;
+};
+
+// Reports every occurrence of pattern in the files below root. Each worker
+// takes a file at a time and reads it in large blocks, keeping the end of
+// the previous block so that matches spanning two are found. Matches within
+// a file are reported in order; files that cannot be opened are skipped.
+// Returns the number of matches reported. Throws std::invalid_argument if
+// pattern is empty, and std::runtime_error if reading a file fails, once
+// the workers have stopped; matches found before then have been reported.
+uint64 search(string const & root, string const & pattern, MatchCallback const & onMatch, SearchOptions const & options = SearchOptions());
+
+// Any of patterns in a single pass over each file, with an Aho-Corasick
+// automaton. Matches that overlap are all reported, in order of where they
+// end. Throws std::invalid_argument if there are no patterns or one is
+// empty, and std::runtime_error as above.
+uint64 search(string const & root, StringList const & patterns, MatchCallback const & onMatch, SearchOptions const & options = SearchOptions());
+
+}
+
+#endif /* _INCLUDE_PHYSFS_SEARCH_HPP_ */
@@ -0,0 +1,407 @@
+#ifndef _INCLUDE_PHYSFS_STREAM_HPP_
+#define _INCLUDE_PHYSFS_STREAM_HPP_
+
+#include <algorithm>
+#include <future>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string.h>
+#include <string_view>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// Policies for basic_ifstream, basic_ofstream and basic_fstream. Each one is
+// a template argument, so the choice is made at compile time and the calls
+// into it can be inlined.
+
+// Allocation policies, used by HeapBuffer.
+
+struct NewAllocation {
+	static void * allocate(std::size_t bytes) {
+		return ::operator new(bytes);
+	}
+
+	static void deallocate(void * block, std::size_t) {
+		::operator delete(block);
+	}
+};
+
+// Keeps a few freed blocks of each size on the freeing thread and hands
+// them out again, so opening streams in a loop stops reaching the heap.
+struct PooledAllocation {
+	static void * allocate(std::size_t bytes);
+	static void deallocate(void * block, std::size_t bytes);
+};
+
+// Buffer policies. storage<AllocPolicy> is what the stream buffer holds.
+
+// Size bytes inside the stream object itself; AllocPolicy is unused.
+template <std::size_t Size = 2048>
+struct InlineBuffer {
+	template <typename AllocPolicy>
+	class storage {
+	private:
+		storage(const storage & other);
+		storage& operator=(const storage& other);
+
+		char bytes[Size];
+	public:
+		static constexpr std::size_t size = Size;
+
+		storage() {}
+
+		char * data() {
+			return bytes;
+		}
+
+		// makes the first used bytes of other ours; other is left unspecified
+		void take(storage & other, std::size_t used) {
+			memcpy(bytes, other.bytes, used);
+		}
+	};
+};
+
+// Size bytes from AllocPolicy.
+template <std::size_t Size = 2048>
+struct HeapBuffer {
+	template <typename AllocPolicy>
+	class storage {
+	private:
+		storage(const storage & other);
+		storage& operator=(const storage& other);
+
+		char * bytes;
+	public:
+		static constexpr std::size_t size = Size;
+
+		storage() : bytes(static_cast<char *>(AllocPolicy::allocate(Size))) {}
+
+		~storage() {
+			AllocPolicy::deallocate(bytes, Size);
+		}
+
+		char * data() {
+			return bytes;
+		}
+
+		void take(storage & other, std::size_t) {
+			std::swap(bytes, other.bytes);
+		}
+	};
+};
+
+// I/O policies. refill<Storage> fills the buffer when it runs dry; settle()
+// is called before anything else touches the file, and pending() is how far
+// the file has been read beyond what read() has returned.
+
+// Reads when the buffer runs dry, on the calling thread.
+struct SyncRefill {
+	template <typename Storage>
+	class refill {
+	public:
+		sint64 read(PHYSFS_File * file, Storage & into) {
+			return PHYSFS_read(file, into.data(), 1, Storage::size);
+		}
+
+		void settle(PHYSFS_File *) {}
+
+		sint64 pending() {
+			return 0;
+		}
+	};
+};
+
+// After each full read, starts reading the next block on another thread
+// into a second buffer, so sequential reads overlap with whatever the
+// caller does in between. Each refill starts a thread, so this pays off for
+// large buffers over slow sources such as compressed archives. Seeking or
+// writing waits for the read in flight and throws it away; asking for the
+// position waits for it and keeps it.
+struct AsyncRefill {
+	template <typename Storage>
+	class refill {
+	private:
+		Storage spare;
+		std::future<sint64> ahead;
+		// what ahead returned, once waited for
+		sint64 aheadBytes;
+		bool collected;
+
+		// waits for the read in flight; false if there is none
+		bool collect() {
+			if (ahead.valid()) {
+				aheadBytes = ahead.get();
+				collected = true;
+			}
+			return collected;
+		}
+	public:
+		refill() : aheadBytes(0), collected(false) {}
+
+		~refill() {
+			if (ahead.valid()) {
+				ahead.wait();
+			}
+		}
+
+		sint64 read(PHYSFS_File * file, Storage & into) {
+			sint64 bytesRead;
+			if (collect()) {
+				bytesRead = aheadBytes;
+				collected = false;
+				if (bytesRead > 0) {
+					into.take(spare, bytesRead);
+				}
+			} else {
+				bytesRead = PHYSFS_read(file, into.data(), 1, Storage::size);
+			}
+			if (bytesRead == (sint64) Storage::size) {
+				char * target = spare.data();
+				ahead = std::async(std::launch::async, [file, target] {
+					return PHYSFS_read(file, target, 1, Storage::size);
+				});
+			}
+			return bytesRead;
+		}
+
+		void settle(PHYSFS_File * file) {
+			sint64 bytesRead = pending();
+			collected = false;
+			if (bytesRead > 0) {
+				PHYSFS_seek(file, PHYSFS_tell(file) - bytesRead);
+			}
+		}
+
+		sint64 pending() {
+			return collect() && aheadBytes > 0 ? aheadBytes : 0;
+		}
+	};
+};
+
+// One buffer shared by reads and writes, as std::filebuf does: switching
+// from reading to writing puts the file back where reading had got to, and
+// switching back writes out what is pending.
+template <typename BufferPolicy, typename AllocPolicy, typename IoPolicy>
+class basic_fbuf : public std::streambuf {
+private:
+	typedef typename BufferPolicy::template storage<AllocPolicy> storage_type;
+
+	basic_fbuf(const basic_fbuf & other);
+	basic_fbuf& operator=(const basic_fbuf& other);
+
+	PHYSFS_File * const file;
+	storage_type storage;
+	typename IoPolicy::template refill<storage_type> reader;
+
+	bool writing() const {
+		return pbase() != NULL;
+	}
+
+	bool flushWrites() {
+		std::ptrdiff_t pending = pptr() - pbase();
+		setp(NULL, NULL);
+		return pending == 0 || PHYSFS_write(file, storage.data(), pending, 1) == 1;
+	}
+
+	void dropReads() {
+		reader.settle(file);
+		std::ptrdiff_t unread = egptr() - gptr();
+		if (unread > 0) {
+			PHYSFS_seek(file, PHYSFS_tell(file) - unread);
+		}
+		setg(NULL, NULL, NULL);
+	}
+
+	int_type underflow() {
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+		if (writing() && !flushWrites()) {
+			return traits_type::eof();
+		}
+		sint64 bytesRead = reader.read(file, storage);
+		if (bytesRead < 1) {
+			setg(NULL, NULL, NULL);
+			return traits_type::eof();
+		}
+		setg(storage.data(), storage.data(), storage.data() + bytesRead);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int_type overflow(int_type c = traits_type::eof()) {
+		if (!writing()) {
+			dropReads();
+		} else if (!flushWrites()) {
+			return traits_type::eof();
+		}
+		setp(storage.data(), storage.data() + storage_type::size);
+		if (c != traits_type::eof()) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int sync() {
+		return !writing() || flushWrites() ? 0 : -1;
+	}
+
+	pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode) {
+		if (offset == 0 && dir == std::ios_base::cur) {
+			// tellg() and tellp(), which leave the buffers as they are; the
+			// read in flight has to land before the file can be asked
+			sint64 ahead = reader.pending();
+			sint64 position = PHYSFS_tell(file);
+			if (position < 0) {
+				return pos_type(off_type(-1));
+			}
+			if (writing()) {
+				return position + (pptr() - pbase());
+			}
+			return position - ahead - (egptr() - gptr());
+		}
+		if (writing() && !flushWrites()) {
+			return pos_type(off_type(-1));
+		}
+		dropReads();
+		sint64 target = offset;
+		if (dir == std::ios_base::cur) {
+			target += PHYSFS_tell(file);
+		} else if (dir == std::ios_base::end) {
+			target += PHYSFS_fileLength(file);
+		}
+		if (target < 0 || !PHYSFS_seek(file, target)) {
+			return pos_type(off_type(-1));
+		}
+		return PHYSFS_tell(file);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode mode) {
+		return seekoff(off_type(pos), std::ios_base::beg, mode);
+	}
+public:
+	explicit basic_fbuf(PHYSFS_File * file) : file(file) {
+		setg(NULL, NULL, NULL);
+		setp(NULL, NULL);
+	}
+
+	~basic_fbuf() {
+		if (writing()) {
+			flushWrites();
+		}
+		reader.settle(file);
+	}
+};
+
+// Streams over a PhysFS file whose buffering is chosen by policy, with the
+// buffer held in the stream rather than allocated apart from it. The
+// defaults behave like ifstream, ofstream and fstream, minus what only
+// those offer: compression, filters, peek() and adaptive read-ahead.
+template <typename BufferPolicy = HeapBuffer<>, typename AllocPolicy = NewAllocation, typename IoPolicy = SyncRefill>
+class basic_ifstream : public base_fstream, public std::istream {
+private:
+	basic_fbuf<BufferPolicy, AllocPolicy, IoPolicy> buffer;
+public:
+	// throws std::invalid_argument if the file cannot be opened
+	explicit basic_ifstream(string const & filename)
+		: base_fstream(filename, READ), std::istream(NULL), buffer(file) {
+		rdbuf(&buffer);
+	}
+};
+
+template <typename BufferPolicy = HeapBuffer<>, typename AllocPolicy = NewAllocation, typename IoPolicy = SyncRefill>
+class basic_ofstream : public base_fstream, public std::ostream {
+private:
+	basic_fbuf<BufferPolicy, AllocPolicy, IoPolicy> buffer;
+public:
+	explicit basic_ofstream(string const & filename, mode writeMode = WRITE)
+		: base_fstream(filename, writeMode), std::ostream(NULL), buffer(file) {
+		rdbuf(&buffer);
+	}
+};
+
+template <typename BufferPolicy = HeapBuffer<>, typename AllocPolicy = NewAllocation, typename IoPolicy = SyncRefill>
+class basic_fstream : public base_fstream, public std::iostream {
+private:
+	basic_fbuf<BufferPolicy, AllocPolicy, IoPolicy> buffer;
+public:
+	explicit basic_fstream(string const & filename, mode openMode = READ)
+		: base_fstream(filename, openMode), std::iostream(NULL), buffer(file) {
+		rdbuf(&buffer);
+	}
+};
+
+// An ifstream for files that are usually under N bytes. The buffer lives in
+// the stream, and a file that fits is read whole by the first refill, so
+// opening and reading one allocates nothing beyond PhysFS's own handle.
+template <std::size_t N = 4096>
+using small_ifstream = basic_ifstream<InlineBuffer<N>, NewAllocation, SyncRefill>;
+
+// The whole of a file, read on construction. A file of up to N bytes is
+// kept inside the object; anything longer goes to the heap.
+template <std::size_t N = 4096>
+class SmallFile {
+private:
+	SmallFile(const SmallFile & other);
+	SmallFile& operator=(const SmallFile& other);
+
+	char bytes[N];
+	string overflowed;
+	std::size_t length;
+
+	static std::size_t const chunkSize = 64 * 1024;
+
+	static void fail(PHYSFS_File * file, string const & filename) {
+		PHYSFS_close(file);
+		PHYSFSPP_THROW(std::runtime_error("could not read " + filename));
+	}
+public:
+	// throws std::invalid_argument if the file cannot be opened and
+	// std::runtime_error if reading it fails
+	explicit SmallFile(string const & filename) : length(0) {
+		PHYSFS_File * file = PHYSFS_openRead(filename.c_str());
+		if (file == NULL) {
+			PHYSFSPP_THROW(std::invalid_argument("file not found: " + filename));
+		}
+		sint64 bytesRead = PHYSFS_read(file, bytes, 1, N);
+		if (bytesRead < 0) {
+			fail(file, filename);
+		}
+		length = bytesRead;
+		if (length == N && !PHYSFS_eof(file)) {
+			sint64 total = PHYSFS_fileLength(file);
+			overflowed.assign(bytes, N);
+			std::size_t step = total > (sint64) N ? total - N : chunkSize;
+			do {
+				std::size_t used = overflowed.size();
+				overflowed.resize(used + step);
+				bytesRead = PHYSFS_read(file, &overflowed[used], 1, step);
+				if (bytesRead < 0) {
+					fail(file, filename);
+				}
+				overflowed.resize(used + bytesRead);
+				step = chunkSize;
+			} while (bytesRead > 0 && !PHYSFS_eof(file));
+			length = overflowed.size();
+		}
+		PHYSFS_close(file);
+	}
+
+	std::string_view view() const {
+		return isInline() ? std::string_view(bytes, length) : std::string_view(overflowed);
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+
+	bool isInline() const {
+		return length <= N && overflowed.empty();
+	}
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_STREAM_HPP_ */
@@ -0,0 +1,45 @@
+#ifndef _INCLUDE_PHYSFS_TREE_OPS_HPP_
+#define _INCLUDE_PHYSFS_TREE_OPS_HPP_
+
+#include <functional>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+struct CopyProgress {
+	string path;
+	uint64 bytesCopied;
+	uint64 fileLength;
+	uint64 filesDone;
+	uint64 filesTotal;
+};
+
+// Called after each block and once a file completes; calls are serialized
+// but may come from worker threads.
+typedef std::function<void(CopyProgress const &)> ProgressCallback;
+
+// Copies a file from the search path into the write dir, returning the bytes
+// copied. When the source lives in a native directory the kernel copies it
+// (copy_file_range, then sendfile); otherwise large aligned blocks are used.
+uint64 copy(string const & source, string const & destination, ProgressCallback const & progress = ProgressCallback());
+
+// Copies every file below sourceDir to destinationDir in the write dir,
+// creating directories as needed, with up to threads workers (0 = one per
+// core). Returns the total bytes copied.
+uint64 extractTree(string const & sourceDir, string const & destinationDir, ProgressCallback const & progress = ProgressCallback(), unsigned threads = 0);
+
+// Creates path and any missing parents in the write dir. Directories it has
+// created or found are remembered, so repeated calls for the same tree do not
+// reach PhysFS; setWriteDir, deleteFile and removeTree drop that memory.
+bool mkdirs(string const & path);
+
+// Deletes path and everything below it from the write dir. Files go first,
+// spread over threads workers (0 = one per core), then directories from the
+// deepest level up. The write dir is walked directly, so it need not be
+// mounted. Returns the number of entries deleted; throws std::runtime_error
+// if there is no write dir or the tree cannot be listed in full.
+uint64 removeTree(string const & path, unsigned threads = 0);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_TREE_OPS_HPP_ */
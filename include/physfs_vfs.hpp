@@ -0,0 +1,54 @@
+#ifndef _INCLUDE_PHYSFS_VFS_HPP_
+#define _INCLUDE_PHYSFS_VFS_HPP_
+
+#include <istream>
+#include <memory>
+#include <mutex>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// A mount table and file index kept outside PhysFS, so that many threads
+// can resolve paths without queueing on PhysFS's global lock. mount and
+// unmount rebuild the index and publish it as a new immutable snapshot;
+// lookups read whichever snapshot is current and never block each other.
+// Files in native directories are then opened directly by the OS, and only
+// archive members go through PhysFS. The index is a snapshot: files written,
+// deleted or mounted around the Vfs are not seen until refresh() is called,
+// so mount everything through one Vfs and refresh it after writing.
+class Vfs {
+private:
+	Vfs(const Vfs & other);
+	Vfs& operator=(const Vfs& other);
+
+	class Snapshot;
+
+	std::shared_ptr<Snapshot const> current() const;
+	void rebuild();
+
+	std::mutex writer;
+	std::shared_ptr<Snapshot const> snapshot;
+public:
+	Vfs();
+	~Vfs();
+
+	Result<void> mount(string const & newDir, string const & mountPoint, bool appendToPath);
+	Result<void> unmount(string const & oldDir);
+	// rebuilds the index from the search path as it is now
+	void refresh();
+
+	bool exists(string const & filename) const;
+	bool isDirectory(string const & filename) const;
+	// the search path entry that provides filename, or "" if none does
+	string getRealDir(string const & filename) const;
+	StringList enumerateFiles(string const & directory) const;
+	// number of files indexed
+	std::size_t size() const;
+
+	// throws std::invalid_argument if filename is not in the index
+	std::unique_ptr<std::istream> openRead(string const & filename) const;
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_VFS_HPP_ */
@@ -0,0 +1,106 @@
+#ifndef _INCLUDE_PHYSFS_WATCH_HPP_
+#define _INCLUDE_PHYSFS_WATCH_HPP_
+
+#include <functional>
+#include <memory>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+struct ChangeEvent {
+	typedef enum {
+		ADDED,
+		REMOVED,
+		MODIFIED,
+		// events were lost; everything below path should be rescanned
+		RESCAN
+	} kind;
+
+	string path;
+	kind type;
+};
+
+typedef std::vector<ChangeEvent> ChangeList;
+
+typedef std::function<void(ChangeList const &)> ChangeCallback;
+
+// Watches native directories on the search path for changes (inotify on
+// Linux) and reports them by virtual path. Events for the same path are
+// merged and delivered from a background thread once no new events have
+// arrived for debounceMilliseconds. A new directory is scanned once watched,
+// so what was created in it before then is reported as ADDED too. Removed
+// directories inside the write dir are also dropped from the mkdirs cache
+// before callback runs; nothing else is updated for you. To keep a Registry
+// or Vfs current, call them from the callback, which runs on the watcher's
+// thread:
+//
+//   PhysFS::Watcher watcher([&](PhysFS::ChangeList const & changes) {
+//       registry.onChange(changes);
+//       vfs.refresh();
+//   });
+class Watcher {
+private:
+	Watcher(const Watcher & other);
+	Watcher& operator=(const Watcher& other);
+
+	class Implementation;
+	std::unique_ptr<Implementation> implementation;
+public:
+	explicit Watcher(ChangeCallback callback, unsigned debounceMilliseconds = 100);
+	~Watcher();
+
+	// Starts watching root in every native directory mounted at or below it.
+	// Returns the number of OS directories now watched; archives are skipped.
+	std::size_t watch(string const & root);
+
+	static bool isSupported();
+};
+
+// Sizes, modification times and source mounts of every file below a root,
+// for finding changes by rescanning when watching is not possible (e.g. an
+// archive replaced in place). Paths share one string pool and each entry
+// takes a fixed 32 bytes.
+class Snapshot {
+public:
+	struct Entry {
+		string path;
+		sint64 size;
+		sint64 modTime;
+		string mount;
+	};
+
+	Snapshot();
+
+	std::size_t size() const;
+	Entry entry(std::size_t index) const;
+	string const & getRoot() const;
+
+	friend Snapshot snapshot(string const & root, unsigned threads);
+	friend ChangeList diff(Snapshot const & before, Snapshot const & after);
+private:
+	struct record {
+		sint64 size;
+		sint64 modTime;
+		uint32 pathOffset;
+		uint32 pathLength;
+		uint32 mount;
+	};
+
+	string path(record const & r) const;
+
+	string root;
+	string paths;
+	std::vector<record> records;
+	StringList mounts;
+};
+
+// scans root with up to threads workers (0 = one per core)
+Snapshot snapshot(string const & root, unsigned threads = 0);
+
+// entries only in after are ADDED, only in before REMOVED, and those whose
+// size, time or mount differ MODIFIED; the list is sorted by path
+ChangeList diff(Snapshot const & before, Snapshot const & after);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_WATCH_HPP_ */
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <string.h>
+#include "physfs_asset.hpp"
+#include "physfs_load.hpp"
+#include "tree.hpp"
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace PhysFS {
+
+namespace {
+
+char const magic[8] = {'P', 'H', 'Y', 'S', 'F', 'S', 'A', '\0'};
+
+uint32 const currentVersion = 1;
+
+uint32 const byteOrderMark = 0x01020304;
+
+}
+
+AssetHeader const & validateAsset(std::string_view bytes) {
+	if (reinterpret_cast<uintptr_t>(bytes.data()) % assetAlignment != 0) {
+		PHYSFSPP_THROW(std::runtime_error("asset is not aligned to assetAlignment"));
+	}
+	if (bytes.size() < sizeof(AssetHeader)) {
+		PHYSFSPP_THROW(std::runtime_error("too short to be an asset"));
+	}
+	AssetHeader const & header = *reinterpret_cast<AssetHeader const *>(bytes.data());
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0) {
+		PHYSFSPP_THROW(std::runtime_error("not an asset"));
+	}
+	if (header.version != currentVersion) {
+		PHYSFSPP_THROW(std::runtime_error("unsupported asset version"));
+	}
+	if (header.byteOrder != byteOrderMark) {
+		PHYSFSPP_THROW(std::runtime_error("asset was written with the other byte order"));
+	}
+	if (header.size != bytes.size()) {
+		PHYSFSPP_THROW(std::runtime_error("asset size does not match its header"));
+	}
+	if (header.rootSize != 0 && (header.root < sizeof(AssetHeader) || header.root > header.size || header.rootSize > header.size - header.root)) {
+		PHYSFSPP_THROW(std::runtime_error("asset root is out of range"));
+	}
+	return header;
+}
+
+AssetBuilder::AssetBuilder() : bytes(sizeof(AssetHeader), 0), root(0), rootSize(0) {}
+
+uint64 AssetBuilder::reserve(std::size_t size, std::size_t alignment) {
+	uint64 where = (bytes.size() + alignment - 1) & ~(uint64) (alignment - 1);
+	bytes.resize(where + size, 0);
+	return where;
+}
+
+uint64 AssetBuilder::addString(std::string_view text) {
+	string key(text);
+	std::map<string, uint64>::const_iterator found = strings.find(key);
+	if (found != strings.end()) {
+		return found->second;
+	}
+	// the terminator comes from the zeroes reserve() adds
+	uint64 where = reserve(text.size() + 1, 1);
+	memcpy(bytes.data() + where, text.data(), text.size());
+	strings[key] = where;
+	return where;
+}
+
+std::vector<char> const & AssetBuilder::finish() {
+	AssetHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = currentVersion;
+	header.byteOrder = byteOrderMark;
+	header.size = bytes.size();
+	header.root = root;
+	header.rootSize = rootSize;
+	memcpy(bytes.data(), &header, sizeof(header));
+	return bytes;
+}
+
+void AssetBuilder::write(string const & filename) {
+	finish();
+	ofstream out(filename);
+	out.write(bytes.data(), bytes.size());
+	out.flush();
+	if (!out) {
+		PHYSFSPP_THROW(std::runtime_error("could not write " + filename));
+	}
+}
+
+class AssetFile::Storage {
+public:
+	backing kind;
+	Buffer loaded;
+	void * mapping;
+	std::size_t mappedSize;
+
+	Storage() : kind(LOADED), mapping(NULL), mappedSize(0) {}
+
+	~Storage() {
+#ifdef __unix__
+		if (mapping != NULL) {
+			munmap(mapping, mappedSize);
+		}
+#endif
+	}
+
+	// false if path cannot be mapped, leaving it to be read instead
+	bool map(string const & path) {
+#ifdef __unix__
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void * mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				mapping = mapped;
+				mappedSize = info.st_size;
+				kind = MAPPED;
+			}
+		}
+		close(fd);
+		return mapping != NULL;
+#else
+		return false;
+#endif
+	}
+};
+
+AssetFile::AssetFile(string const & filename, backing preferred) : storage(new Storage()) {
+	string native = preferred == MAPPED ? nativePath(filename) : string();
+	if (native.empty() || !storage->map(native)) {
+		storage->loaded = readAll(filename, ReadOptions().alignment(assetAlignment));
+	}
+	validateAsset(bytes());
+}
+
+AssetFile::~AssetFile() {}
+
+AssetFile::backing AssetFile::getBacking() const {
+	return storage->kind;
+}
+
+std::string_view AssetFile::bytes() const {
+	if (storage->kind == MAPPED) {
+		return std::string_view(static_cast<char const *>(storage->mapping), storage->mappedSize);
+	}
+	return storage->loaded.view();
+}
+
+}
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "physfs_budget.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+struct cache {
+	uint64 id;
+	double cost;
+	UsageFunction usage;
+	ShrinkFunction shrink;
+};
+
+bool cheaper(cache const & a, cache const & b) {
+	return a.cost < b.cost;
+}
+
+// the "some avg10" percentage from /proc/pressure/memory, or -1
+double memoryStall() {
+	std::ifstream pressure("/proc/pressure/memory");
+	string line;
+	while (std::getline(pressure, line)) {
+		string::size_type found = line.find("avg10=");
+		if (line.compare(0, 5, "some ") == 0 && found != string::npos) {
+			return atof(line.c_str() + found + 6);
+		}
+	}
+	return -1;
+}
+
+// directory holding this process's cgroup v2 files, or "" without one
+string cgroupDir() {
+	std::ifstream membership("/proc/self/cgroup");
+	string line;
+	while (std::getline(membership, line)) {
+		if (line.compare(0, 3, "0::") == 0) {
+			string dir = "/sys/fs/cgroup" + line.substr(3);
+			if (std::ifstream((dir + "/memory.current").c_str())) {
+				return dir;
+			}
+		}
+	}
+	return "";
+}
+
+// a cgroup memory file's value, or 0 for "max", unreadable or missing
+uint64 cgroupValue(string const & dir, char const * name) {
+	std::ifstream file((dir + "/" + name).c_str());
+	uint64 value = 0;
+	if (!(file >> value)) {
+		return 0;
+	}
+	return value;
+}
+
+}
+
+PressureOptions::PressureOptions() : milliseconds(1000), stall(10), cgroup(0.9), keep(0.5) {}
+
+PressureOptions & PressureOptions::interval(unsigned milliseconds) {
+	if (milliseconds == 0) {
+		PHYSFSPP_THROW(std::invalid_argument("pressure interval must not be 0"));
+	}
+	this->milliseconds = milliseconds;
+	return *this;
+}
+
+PressureOptions & PressureOptions::stallPercent(double percent) {
+	stall = percent;
+	return *this;
+}
+
+PressureOptions & PressureOptions::cgroupFraction(double fraction) {
+	cgroup = fraction;
+	return *this;
+}
+
+PressureOptions & PressureOptions::keepFraction(double fraction) {
+	if (fraction < 0 || fraction > 1) {
+		PHYSFSPP_THROW(std::invalid_argument("keep fraction must be between 0 and 1"));
+	}
+	keep = fraction;
+	return *this;
+}
+
+unsigned PressureOptions::getInterval() const {
+	return milliseconds;
+}
+
+double PressureOptions::getStallPercent() const {
+	return stall;
+}
+
+double PressureOptions::getCgroupFraction() const {
+	return cgroup;
+}
+
+double PressureOptions::getKeepFraction() const {
+	return keep;
+}
+
+class MemoryBudget::State {
+public:
+	// guards caches; the functions in them are called without it
+	std::mutex lock;
+	// one trim at a time
+	std::mutex trimming;
+	// cheapest first
+	std::vector<cache> caches;
+	uint64 nextId;
+
+	std::mutex watchLock;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread watcher;
+
+	State() : nextId(1), stopping(false) {}
+
+	// a copy, so that a slow cache such as a MemoryWriteDir flushing to disk
+	// does not hold up add and remove
+	std::vector<cache> snapshot() {
+		std::lock_guard<std::mutex> guard(lock);
+		return caches;
+	}
+
+	static std::size_t usage(std::vector<cache> const & current) {
+		std::size_t total = 0;
+		for (std::size_t i = 0; i < current.size(); i++) {
+			total += current[i].usage();
+		}
+		return total;
+	}
+
+	// to target, or to keep times the usage when keep is below 1
+	std::size_t trim(std::size_t target, double keep = 1) {
+		std::lock_guard<std::mutex> guard(trimming);
+		std::vector<cache> current = snapshot();
+		std::size_t total = usage(current);
+		if (keep < 1) {
+			target = total * keep;
+		}
+		std::size_t released = 0;
+		for (std::size_t i = 0; i < current.size() && total > target; i++) {
+			std::size_t held = current[i].usage();
+			std::size_t excess = total - target;
+			std::size_t freed = current[i].shrink(held > excess ? held - excess : 0);
+			released += freed;
+			total -= freed < total ? freed : total;
+		}
+		return released;
+	}
+
+	bool underPressure(PressureOptions const & options, string const & cgroup) {
+		double stall = memoryStall();
+		if (stall >= 0 && stall >= options.getStallPercent()) {
+			return true;
+		}
+		if (cgroup.empty()) {
+			return false;
+		}
+		uint64 limit = cgroupValue(cgroup, "memory.high");
+		if (limit == 0) {
+			limit = cgroupValue(cgroup, "memory.max");
+		}
+		return limit > 0 && cgroupValue(cgroup, "memory.current") >= limit * options.getCgroupFraction();
+	}
+
+	void watch(PressureOptions options, string cgroup) {
+		std::chrono::milliseconds interval(options.getInterval());
+		std::unique_lock<std::mutex> guard(watchLock);
+		while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+			guard.unlock();
+			if (underPressure(options, cgroup)) {
+				trim(0, options.getKeepFraction());
+			}
+			guard.lock();
+		}
+	}
+};
+
+MemoryBudget::MemoryBudget() : state(new State()) {}
+
+MemoryBudget::~MemoryBudget() {
+	stopWatching();
+}
+
+MemoryBudget & MemoryBudget::global() {
+	static MemoryBudget budget;
+	return budget;
+}
+
+uint64 MemoryBudget::add(double cost, UsageFunction const & usage, ShrinkFunction const & shrink) {
+	std::lock_guard<std::mutex> guard(state->lock);
+	cache added = {state->nextId++, cost, usage, shrink};
+	state->caches.insert(std::upper_bound(state->caches.begin(), state->caches.end(), added, cheaper), added);
+	return added.id;
+}
+
+void MemoryBudget::remove(uint64 id) {
+	std::lock_guard<std::mutex> guard(state->lock);
+	for (std::size_t i = 0; i < state->caches.size(); i++) {
+		if (state->caches[i].id == id) {
+			state->caches.erase(state->caches.begin() + i);
+			return;
+		}
+	}
+}
+
+std::size_t MemoryBudget::usage() const {
+	return State::usage(state->snapshot());
+}
+
+std::size_t MemoryBudget::trim(std::size_t targetBytes) {
+	return state->trim(targetBytes);
+}
+
+bool MemoryBudget::watchPressure(PressureOptions const & options) {
+	string cgroup = cgroupDir();
+	if (memoryStall() < 0 && cgroup.empty()) {
+		return false;
+	}
+	stopWatching();
+	state->stopping = false;
+	state->watcher = std::thread(&State::watch, state.get(), options, cgroup);
+	return true;
+}
+
+void MemoryBudget::stopWatching() {
+	if (!state->watcher.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(state->watchLock);
+		state->stopping = true;
+	}
+	state->wake.notify_all();
+	state->watcher.join();
+}
+
+}
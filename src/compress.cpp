@@ -0,0 +1,600 @@
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string.h>
+#include <thread>
+#include <vector>
+#ifdef PHYSFSPP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef PHYSFSPP_HAVE_LZ4
+#include <lz4.h>
+#endif
+#include "physfs_filter.hpp"
+#include "compress.hpp"
+#include "fbuf.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+// codec, uncompressed size and compressed size, each a little-endian uint32
+std::size_t const frameHeaderSize = 12;
+
+// guards against allocating garbage sizes from a corrupt header
+uint32 const maxFrameSize = 1 << 30;
+
+void writeFrameHeader(char * dst, uint32 method, uint32 rawSize, uint32 packedSize) {
+	uint32 header[3] = {
+		PHYSFS_swapULE32(method),
+		PHYSFS_swapULE32(rawSize),
+		PHYSFS_swapULE32(packedSize)
+	};
+	memcpy(dst, header, frameHeaderSize);
+}
+
+bool readFrameHeader(char const * src, uint32 & method, uint32 & rawSize, uint32 & packedSize) {
+	uint32 header[3];
+	memcpy(header, src, frameHeaderSize);
+	method = PHYSFS_swapULE32(header[0]);
+	rawSize = PHYSFS_swapULE32(header[1]);
+	packedSize = PHYSFS_swapULE32(header[2]);
+	return rawSize <= maxFrameSize && packedSize <= maxFrameSize;
+}
+
+class codecContext {
+private:
+	codecContext(const codecContext & other);
+	codecContext& operator=(const codecContext& other);
+
+#ifdef PHYSFSPP_HAVE_ZSTD
+	ZSTD_CCtx * cctx;
+	ZSTD_DCtx * dctx;
+#endif
+public:
+#ifdef PHYSFSPP_HAVE_ZSTD
+	codecContext() : cctx(NULL), dctx(NULL) {}
+
+	~codecContext() {
+		ZSTD_freeCCtx(cctx);
+		ZSTD_freeDCtx(dctx);
+	}
+#else
+	codecContext() {}
+#endif
+
+	static std::size_t bound(Compress::codec method, std::size_t size) {
+		switch (method) {
+#ifdef PHYSFSPP_HAVE_ZSTD
+		case Compress::ZSTD:
+			return ZSTD_compressBound(size);
+#endif
+#ifdef PHYSFSPP_HAVE_LZ4
+		case Compress::LZ4:
+			return LZ4_compressBound(size);
+#endif
+		default:
+			return size;
+		}
+	}
+
+	// returns the compressed size, or 0 if the frame should be stored raw
+	std::size_t pack(Compress const & compression, char const * src, std::size_t size, char * dst, std::size_t capacity) {
+		// unused when built without any codec
+		(void) src;
+		(void) size;
+		(void) dst;
+		(void) capacity;
+		switch (compression.getMethod()) {
+#ifdef PHYSFSPP_HAVE_ZSTD
+		case Compress::ZSTD: {
+			if (cctx == NULL) {
+				cctx = ZSTD_createCCtx();
+			}
+			std::size_t packed = ZSTD_compressCCtx(cctx, dst, capacity, src, size, compression.getLevel());
+			return ZSTD_isError(packed) ? 0 : packed;
+		}
+#endif
+#ifdef PHYSFSPP_HAVE_LZ4
+		case Compress::LZ4: {
+			int packed = LZ4_compress_fast(src, dst, size, capacity, compression.getLevel());
+			return packed > 0 ? packed : 0;
+		}
+#endif
+		default:
+			return 0;
+		}
+	}
+
+	bool unpack(uint32 method, char const * src, std::size_t size, char * dst, std::size_t rawSize) {
+		switch (method) {
+		case Compress::NONE:
+			if (size != rawSize) {
+				return false;
+			}
+			memcpy(dst, src, size);
+			return true;
+#ifdef PHYSFSPP_HAVE_ZSTD
+		case Compress::ZSTD: {
+			if (dctx == NULL) {
+				dctx = ZSTD_createDCtx();
+			}
+			std::size_t unpacked = ZSTD_decompressDCtx(dctx, dst, rawSize, src, size);
+			return !ZSTD_isError(unpacked) && unpacked == rawSize;
+		}
+#endif
+#ifdef PHYSFSPP_HAVE_LZ4
+		case Compress::LZ4:
+			return LZ4_decompress_safe(src, dst, size, rawSize) == (int) rawSize;
+#endif
+		default:
+			return false;
+		}
+	}
+};
+
+std::size_t frameBound(Compress const & compression, std::size_t size) {
+	return frameHeaderSize + codecContext::bound(compression.getMethod(), size);
+}
+
+// writes a header and payload for size bytes to dst, which must hold
+// frameBound bytes; frames are stored raw when compression does not pay off
+std::size_t packFrame(codecContext & context, Compress const & compression, char const * src, std::size_t size, char * dst) {
+	char * payload = dst + frameHeaderSize;
+	uint32 method = compression.getMethod();
+	std::size_t packedSize = context.pack(compression, src, size, payload, frameBound(compression, size) - frameHeaderSize);
+	if (packedSize == 0 || packedSize >= size) {
+		method = Compress::NONE;
+		memcpy(payload, src, size);
+		packedSize = size;
+	}
+	writeFrameHeader(dst, method, size, packedSize);
+	return frameHeaderSize + packedSize;
+}
+
+class ozbuf : public std::streambuf {
+private:
+	ozbuf(const ozbuf & other);
+	ozbuf& operator=(const ozbuf& other);
+
+	bool flushFrame() {
+		std::size_t size = pptr() - pbase();
+		if (size == 0) {
+			return true;
+		}
+		packed.resize(frameBound(compression, size));
+		std::size_t total = packFrame(context, compression, pbase(), size, &packed[0]);
+		setp(&raw[0], &raw[0] + raw.size());
+		return next->sputn(&packed[0], total) == (std::streamsize) total;
+	}
+
+	int_type overflow(int_type c = traits_type::eof()) {
+		if (!flushFrame()) {
+			return traits_type::eof();
+		}
+		if (c != traits_type::eof()) {
+			*pptr() = c;
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int sync() {
+		if (!flushFrame()) {
+			return -1;
+		}
+		return next->pubsync();
+	}
+
+	std::unique_ptr<fbuf> next;
+	Compress const compression;
+	codecContext context;
+	std::vector<char> raw;
+	std::vector<char> packed;
+public:
+	ozbuf(PHYSFS_File * file, Compress const & compression)
+		: next(new fbuf(file)), compression(compression), raw(compression.getFrameSize()) {
+		setp(&raw[0], &raw[0] + raw.size());
+	}
+
+	~ozbuf() {
+		sync();
+	}
+};
+
+class izbuf : public peekbuf {
+private:
+	izbuf(const izbuf & other);
+	izbuf& operator=(const izbuf& other);
+
+	struct frame {
+		uint32 method;
+		std::vector<char> packed;
+		std::vector<char> raw;
+		bool valid;
+	};
+
+	// false at the end of the frames; anything but a clean end also sets
+	// corrupt
+	bool readFrame(frame & f) {
+		char header[frameHeaderSize];
+		std::streamsize got = source->sgetn(header, frameHeaderSize);
+		if (got != (std::streamsize) frameHeaderSize) {
+			corrupt = got > 0;
+			return false;
+		}
+		uint32 rawSize, packedSize;
+		if (!readFrameHeader(header, f.method, rawSize, packedSize)) {
+			corrupt = true;
+			return false;
+		}
+		f.raw.resize(rawSize);
+		f.packed.resize(packedSize);
+		if (source->sgetn(f.packed.data(), packedSize) != (std::streamsize) packedSize) {
+			corrupt = true;
+			return false;
+		}
+		return true;
+	}
+
+	static void decode(frame * f, codecContext * context) {
+		f->valid = context->unpack(f->method, f->packed.data(), f->packed.size(), f->raw.data(), f->raw.size());
+	}
+
+	// up to one frame per context, read on the calling thread
+	std::size_t readBatch() {
+		std::size_t count = 0;
+		while (count < batch.size() && readFrame(batch[count])) {
+			count++;
+		}
+		return count;
+	}
+
+	// queues the decoded frames of the batch, stopping at a bad one
+	void collect(std::size_t count) {
+		for (std::size_t i = 0; i < count; i++) {
+			if (!batch[i].valid) {
+				corrupt = true;
+				break;
+			}
+			if (!batch[i].raw.empty()) {
+				ready.push_back(std::vector<char>());
+				ready.back().swap(batch[i].raw);
+			}
+		}
+	}
+
+	// reads the next batch and hands it to the workers without waiting
+	void dispatch() {
+		std::size_t count = readBatch();
+		std::lock_guard<std::mutex> guard(lock);
+		inFlight = count;
+		claimed = 0;
+		decoded = 0;
+		wake.notify_all();
+	}
+
+	void work() {
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;) {
+			wake.wait(guard, [this] { return stopping || claimed < inFlight; });
+			if (stopping) {
+				return;
+			}
+			std::size_t i = claimed++;
+			guard.unlock();
+			decode(&batch[i], contexts[i].get());
+			guard.lock();
+			if (++decoded == inFlight) {
+				done.notify_one();
+			}
+		}
+	}
+
+	// With one thread, reads and decodes a frame at a time. With more, the
+	// workers decode the next batch while the caller reads this one.
+	bool fill() {
+		if (workers.empty()) {
+			if (corrupt) {
+				return false;
+			}
+			std::size_t count = readBatch();
+			if (count > 0) {
+				decode(&batch[0], contexts[0].get());
+			}
+			collect(count);
+			return !ready.empty();
+		}
+		if (!started) {
+			started = true;
+			dispatch();
+		}
+		while (ready.empty() && inFlight > 0) {
+			std::size_t count;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				done.wait(guard, [this] { return decoded == inFlight; });
+				count = inFlight;
+				inFlight = 0;
+			}
+			collect(count);
+			if (!corrupt) {
+				dispatch();
+			}
+		}
+		return !ready.empty();
+	}
+
+	int_type underflow() {
+		if (gptr() < egptr()) {
+			return (unsigned char) *gptr();
+		}
+		if (ready.empty() && !fill()) {
+			if (corrupt) {
+				// the istream turns this into badbit, and rethrows it only
+				// if asked to with exceptions()
+#ifndef PHYSFSPP_NO_EXCEPTIONS
+				throw std::runtime_error("compressed file is corrupt or truncated");
+#endif
+			}
+			return traits_type::eof();
+		}
+		current.swap(ready.front());
+		ready.pop_front();
+		char * begin = &current[0];
+		setg(begin, begin, begin + current.size());
+		return (unsigned char) *gptr();
+	}
+
+	std::unique_ptr<fbuf> source;
+	// one per frame in a batch; frame i is always decoded with context i
+	std::vector<std::unique_ptr<codecContext> > contexts;
+	std::vector<frame> batch;
+	std::deque<std::vector<char> > ready;
+	std::vector<char> current;
+	bool corrupt;
+
+	// the workers, which live as long as the stream
+	std::vector<std::thread> workers;
+	// guards inFlight, claimed, decoded and stopping
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	// frames of batch being decoded, handed out and finished
+	std::size_t inFlight;
+	std::size_t claimed;
+	std::size_t decoded;
+	bool started;
+	bool stopping;
+public:
+	izbuf(PHYSFS_File * file, Compress const & compression)
+		: source(new fbuf(file)), corrupt(false), inFlight(0), claimed(0), decoded(0), started(false), stopping(false) {
+		unsigned threads = compression.getThreads() > 0 ? compression.getThreads() : 1;
+		for (unsigned i = 0; i < threads; i++) {
+			contexts.push_back(std::unique_ptr<codecContext>(new codecContext()));
+		}
+		batch.resize(threads);
+		for (unsigned i = 0; threads > 1 && i < threads; i++) {
+			workers.push_back(std::thread(&izbuf::work, this));
+		}
+	}
+
+	~izbuf() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+};
+
+class compressStage : public Filter {
+public:
+	compressStage(Compress const & compression) : compression(compression) {}
+
+	// cuts the input into frames of getFrameSize() bytes, whatever size the
+	// chunks arrive in
+	void push(Chunk && chunk, ChunkSink & next) {
+		std::size_t const frameSize = compression.getFrameSize();
+		char const * data = chunk.data();
+		std::size_t size = chunk.size();
+		if (!pending.empty()) {
+			std::size_t taken = frameSize - pending.size() < size ? frameSize - pending.size() : size;
+			pending.insert(pending.end(), data, data + taken);
+			data += taken;
+			size -= taken;
+			if (pending.size() < frameSize) {
+				return;
+			}
+			packInto(pending.data(), pending.size(), next);
+			pending.clear();
+		}
+		for (; size >= frameSize; data += frameSize, size -= frameSize) {
+			packInto(data, frameSize, next);
+		}
+		pending.assign(data, data + size);
+	}
+
+	// the last frame, which may be short
+	void finish(ChunkSink & next) {
+		if (!pending.empty()) {
+			packInto(pending.data(), pending.size(), next);
+			pending.clear();
+		}
+	}
+private:
+	void packInto(char const * data, std::size_t size, ChunkSink & next) {
+		Chunk out(frameBound(compression, size));
+		out.resize(packFrame(context, compression, data, size, out.data()));
+		next.push(std::move(out));
+	}
+
+	Compress const compression;
+	codecContext context;
+	// the start of a frame still short of getFrameSize() bytes
+	std::vector<char> pending;
+};
+
+class decompressStage : public Filter {
+public:
+	decompressStage() : failed(false) {}
+
+	void push(Chunk && chunk, ChunkSink & next) {
+		if (failed) {
+			return;
+		}
+		if (carry.empty()) {
+			std::size_t used = unpackFrames(chunk.data(), chunk.size(), next);
+			carry.assign(chunk.data() + used, chunk.data() + chunk.size());
+			return;
+		}
+		carry.insert(carry.end(), chunk.data(), chunk.data() + chunk.size());
+		std::size_t used = unpackFrames(carry.data(), carry.size(), next);
+		carry.erase(carry.begin(), carry.begin() + used);
+	}
+
+	// a frame still waiting for the rest of its bytes means the input was cut
+	// short
+	void finish(ChunkSink &) {
+		if (!failed && !carry.empty()) {
+			fail();
+		}
+	}
+private:
+	// as izbuf does: the istream reading through this stage turns the
+	// exception into badbit; builds without exceptions just see the end
+	void fail() {
+		failed = true;
+		carry.clear();
+#ifndef PHYSFSPP_NO_EXCEPTIONS
+		throw std::runtime_error("compressed stream is corrupt or truncated");
+#endif
+	}
+
+	// decodes every complete frame in data, returning the bytes consumed;
+	// a partial frame at the end waits in carry for the next chunk
+	std::size_t unpackFrames(char const * data, std::size_t size, ChunkSink & next) {
+		std::size_t used = 0;
+		while (size - used >= frameHeaderSize) {
+			uint32 method, rawSize, packedSize;
+			if (!readFrameHeader(data + used, method, rawSize, packedSize)) {
+				fail();
+				return size;
+			}
+			if (size - used - frameHeaderSize < packedSize) {
+				break;
+			}
+			Chunk out(rawSize);
+			if (!context.unpack(method, data + used + frameHeaderSize, packedSize, out.data(), rawSize)) {
+				fail();
+				return size;
+			}
+			out.resize(rawSize);
+			next.push(std::move(out));
+			used += frameHeaderSize + packedSize;
+		}
+		return used;
+	}
+
+	codecContext context;
+	std::vector<char> carry;
+	bool failed;
+};
+
+void requireAvailable(Compress const & compression) {
+	if (!Compress::isAvailable(compression.getMethod())) {
+		PHYSFSPP_THROW(std::invalid_argument("compression codec not available in this build"));
+	}
+}
+
+}
+
+Compress::Compress(codec method, int level)
+	: method(method), level(level), threadCount(1), frameBytes(128 * 1024) {}
+
+Compress Compress::none() {
+	return Compress(NONE, 0);
+}
+
+Compress Compress::zstd(int level) {
+	return Compress(ZSTD, level);
+}
+
+Compress Compress::lz4(int acceleration) {
+	return Compress(LZ4, acceleration);
+}
+
+bool Compress::isAvailable(codec method) {
+	switch (method) {
+	case NONE:
+		return true;
+	case ZSTD:
+#ifdef PHYSFSPP_HAVE_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	case LZ4:
+#ifdef PHYSFSPP_HAVE_LZ4
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+Compress & Compress::threads(unsigned count) {
+	threadCount = count > 0 ? count : 1;
+	return *this;
+}
+
+Compress & Compress::frameSize(std::size_t bytes) {
+	if (bytes < 1) {
+		bytes = 1;
+	}
+	frameBytes = bytes < maxFrameSize ? bytes : maxFrameSize;
+	return *this;
+}
+
+Compress::codec Compress::getMethod() const {
+	return method;
+}
+
+int Compress::getLevel() const {
+	return level;
+}
+
+unsigned Compress::getThreads() const {
+	return threadCount;
+}
+
+std::size_t Compress::getFrameSize() const {
+	return frameBytes;
+}
+
+std::streambuf * compressingBuffer(PHYSFS_File * file, Compress const & compression) {
+	requireAvailable(compression);
+	return new ozbuf(file, compression);
+}
+
+std::streambuf * decompressingBuffer(PHYSFS_File * file, Compress const & compression) {
+	// frames record their own codec, so only the thread count matters here
+	return new izbuf(file, compression);
+}
+
+std::unique_ptr<Filter> compressFilter(Compress const & compression) {
+	requireAvailable(compression);
+	return std::unique_ptr<Filter>(new compressStage(compression));
+}
+
+std::unique_ptr<Filter> decompressFilter() {
+	return std::unique_ptr<Filter>(new decompressStage());
+}
+
+}
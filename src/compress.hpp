@@ -0,0 +1,15 @@
+#ifndef _INCLUDE_PHYSFS_COMPRESS_HPP_
+#define _INCLUDE_PHYSFS_COMPRESS_HPP_
+
+#include <streambuf>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+std::streambuf * compressingBuffer(PHYSFS_File * file, Compress const & compression);
+
+std::streambuf * decompressingBuffer(PHYSFS_File * file, Compress const & compression);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_COMPRESS_HPP_ */
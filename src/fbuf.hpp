@@ -0,0 +1,315 @@
+#ifndef _INCLUDE_PHYSFS_FBUF_HPP_
+#define _INCLUDE_PHYSFS_FBUF_HPP_
+
+#include <memory>
+#include <streambuf>
+#include <string.h>
+#include <string_view>
+#include <vector>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// throws std::invalid_argument if PhysFS cannot open the file
+PHYSFS_File* openWithMode(char const * filename, mode openMode);
+
+// NULL, with PHYSFS_getLastError() set, if PhysFS cannot open the file
+PHYSFS_File* tryOpenWithMode(char const * filename, mode openMode);
+
+// closes a file opened without a stream
+class fileHandle {
+private:
+	fileHandle(const fileHandle & other);
+	fileHandle& operator=(const fileHandle& other);
+public:
+	fileHandle(PHYSFS_File * file) : file(file) {}
+
+	~fileHandle() {
+		PHYSFS_close(file);
+	}
+
+	PHYSFS_File * const file;
+};
+
+// Read buffers whose get area can be inspected in place. When a peek asks
+// for more than is buffered, the bytes are gathered into spill and the get
+// area points there until it is used up; the derived underflow then carries
+// on from where it left off, as it never looks at the old get area.
+class peekbuf : public std::streambuf {
+private:
+	std::vector<char> spill;
+protected:
+	std::size_t available() const {
+		return egptr() - gptr();
+	}
+public:
+	// bytes left to read, or -1 when that is not known up front
+	virtual sint64 remaining() {
+		return -1;
+	}
+
+	std::string_view contiguous() {
+		if (gptr() == egptr() && underflow() == traits_type::eof()) {
+			return std::string_view();
+		}
+		return std::string_view(gptr(), available());
+	}
+
+	std::string_view peek(std::size_t count) {
+		if (available() < count) {
+			std::vector<char> gathered(gptr(), egptr());
+			setg(egptr(), egptr(), egptr());
+			while (gathered.size() < count && underflow() != traits_type::eof()) {
+				gathered.insert(gathered.end(), gptr(), egptr());
+				setg(egptr(), egptr(), egptr());
+			}
+			spill.swap(gathered);
+			if (spill.empty()) {
+				return std::string_view();
+			}
+			setg(spill.data(), spill.data(), spill.data() + spill.size());
+		}
+		return std::string_view(gptr(), available() < count ? available() : count);
+	}
+
+	void consume(std::size_t count) {
+		while (count > 0) {
+			if (gptr() == egptr() && underflow() == traits_type::eof()) {
+				return;
+			}
+			std::size_t step = available() < count ? available() : count;
+			setg(eback(), gptr() + step, egptr());
+			count -= step;
+		}
+	}
+};
+
+// NULL if rdbuf() has been replaced by something other than a PhysFS buffer
+inline peekbuf * peekable(std::streambuf * buffer) {
+	return dynamic_cast<peekbuf *>(buffer);
+}
+
+// Sizes reads from how a file is being used. Each read that starts where
+// the last one ended doubles the window, up to maximum; a read anywhere else
+// drops it back to minimum.
+class accessPattern {
+private:
+	std::size_t const minimum;
+	std::size_t const maximum;
+	std::size_t current;
+	sint64 expected;
+	bool sequential;
+	bool started;
+	// reads in a row that began where the one before ended; the first read
+	// of the file has nothing before it, so it never counts
+	unsigned streak;
+public:
+	accessPattern(std::size_t minimum, std::size_t maximum)
+		: minimum(minimum), maximum(maximum > minimum ? maximum : minimum), current(minimum),
+		  expected(0), sequential(false), started(false), streak(0) {}
+
+	// window for a read starting at position
+	std::size_t next(sint64 position) {
+		if (position != expected) {
+			current = minimum;
+			sequential = false;
+		} else if (sequential) {
+			current = ahead();
+		}
+		return current;
+	}
+
+	void advance(sint64 start, sint64 bytesRead) {
+		sequential = start == expected;
+		streak = sequential && started ? streak + 1 : 0;
+		started = true;
+		expected = start + (bytesRead > 0 ? bytesRead : 0);
+	}
+
+	// true once two reads in a row have followed on, which is worth telling
+	// the OS about
+	bool isStreaming() const {
+		return streak >= 2;
+	}
+
+	// window the next sequential read will get
+	std::size_t ahead() const {
+		return current * 2 < maximum ? current * 2 : maximum;
+	}
+};
+
+// Page cache hints for a file read from a native directory. PhysFS keeps
+// its descriptor to itself, so the file is opened a second time on the
+// first hint; archives and platforms without posix_fadvise are ignored.
+class nativeHints {
+private:
+	nativeHints(const nativeHints & other);
+	nativeHints& operator=(const nativeHints& other);
+
+	string const path;
+	int fd;
+	bool opened;
+public:
+	explicit nativeHints(string const & path);
+	~nativeHints();
+
+	// asks the OS to start reading length bytes at offset in the background
+	void willNeed(sint64 offset, sint64 length);
+};
+
+class fbuf : public peekbuf {
+private:
+	fbuf(const fbuf & other);
+	fbuf& operator=(const fbuf& other);
+
+	static std::size_t const maxReadAhead = 256 * 1024;
+
+	int_type underflow() {
+		if (PHYSFS_eof(file)) {
+			return traits_type::eof();
+		}
+		PHYSFS_sint64 position = PHYSFS_tell(file);
+		std::size_t window = pattern.next(position);
+		if (incoming.size() < window) {
+			incoming.resize(window);
+		}
+		PHYSFS_sint64 bytesRead = PHYSFS_read(file, incoming.data(), 1, window);
+		pattern.advance(position, bytesRead);
+		if (bytesRead < 1) {
+			return traits_type::eof();
+		}
+		// nothing is left to hint at once a read comes up short or reaches
+		// the end
+		if (hints && pattern.isStreaming() && (std::size_t) bytesRead == window && unbuffered() > 0) {
+			hints->willNeed(position + bytesRead, pattern.ahead() * 2);
+		}
+		setg(incoming.data(), incoming.data(), incoming.data() + bytesRead);
+		return (unsigned char) *gptr();
+	}
+
+	// reads larger than the buffer go straight into the destination
+	std::streamsize xsgetn(char * destination, std::streamsize count) {
+		std::streamsize buffered = egptr() - gptr();
+		if (count - buffered < (std::streamsize) bufferSize) {
+			return std::streambuf::xsgetn(destination, count);
+		}
+		memcpy(destination, gptr(), buffered);
+		setg(egptr(), egptr(), egptr());
+		PHYSFS_sint64 position = PHYSFS_tell(file);
+		pattern.next(position);
+		PHYSFS_sint64 bytesRead = PHYSFS_read(file, destination + buffered, 1, count - buffered);
+		pattern.advance(position, bytesRead);
+		return buffered + (bytesRead > 0 ? bytesRead : 0);
+	}
+
+	pos_type seekoff(off_type pos, std::ios_base::seekdir dir, std::ios_base::openmode mode) {
+		switch (dir) {
+		case std::ios_base::beg:
+			PHYSFS_seek(file, pos);
+			break;
+		case std::ios_base::cur:
+			// subtract characters currently in buffer from seek position
+			PHYSFS_seek(file, (PHYSFS_tell(file) + pos) - (egptr() - gptr()));
+			break;
+		case std::ios_base::end:
+			PHYSFS_seek(file, PHYSFS_fileLength(file) + pos);
+			break;
+		}
+		if (mode & std::ios_base::in) {
+			setg(egptr(), egptr(), egptr());
+		}
+		if (mode & std::ios_base::out) {
+			setp(buffer, buffer);
+		}
+		return PHYSFS_tell(file);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode mode) {
+		PHYSFS_seek(file, pos);
+		if (mode & std::ios_base::in) {
+			setg(egptr(), egptr(), egptr());
+		}
+		if (mode & std::ios_base::out) {
+			setp(buffer, buffer);
+		}
+		return PHYSFS_tell(file);
+	}
+
+	int_type overflow( int_type c = traits_type::eof() ) {
+		if (pptr() == pbase() && c == traits_type::eof()) {
+			return 0; // no-op
+		}
+		if (PHYSFS_write(file, pbase(), pptr() - pbase(), 1) < 1) {
+			return traits_type::eof();
+		}
+		if (c != traits_type::eof()) {
+			if (PHYSFS_write(file, &c, 1, 1) < 1) {
+				return traits_type::eof();
+			}
+		}
+		setp(buffer, buffer + bufferSize);
+		length = -1;
+
+		return 0;
+	}
+
+	int sync() {
+		return overflow();
+	}
+
+	// bytes after the buffered ones; -1 tells in_avail() that underflow
+	// would hit the end of the file
+	std::streamsize showmanyc() {
+		sint64 left = unbuffered();
+		return left > 0 ? left : -1;
+	}
+
+	sint64 unbuffered() {
+		if (length < 0) {
+			length = PHYSFS_fileLength(file);
+		}
+		PHYSFS_sint64 position = PHYSFS_tell(file);
+		if (length < 0 || position < 0) {
+			return 0;
+		}
+		return length > position ? length - position : 0;
+	}
+
+	char * buffer;
+	size_t const bufferSize;
+	// cached file length, -1 until known or after a write
+	sint64 length;
+	// reads are kept apart from buffer so a fstream read never lands on
+	// pending writes
+	std::vector<char> incoming;
+	accessPattern pattern;
+	std::unique_ptr<nativeHints> hints;
+protected:
+	PHYSFS_File * const file;
+public:
+	fbuf(PHYSFS_File * file, std::size_t bufferSize = 2048)
+		: bufferSize(bufferSize), length(-1), pattern(bufferSize, maxReadAhead), file(file) {
+		buffer = new char[bufferSize];
+		char * end = buffer + bufferSize;
+		setg(end, end, end);
+		setp(buffer, end);
+	}
+
+	// a read-only file opened from path, which may get page cache hints
+	fbuf(PHYSFS_File * file, string const & path) : fbuf(file) {
+		hints.reset(new nativeHints(path));
+	}
+
+	sint64 remaining() {
+		return available() + unbuffered();
+	}
+
+	~fbuf() {
+		sync();
+		delete [] buffer;
+	}
+};
+
+}
+
+#endif /* _INCLUDE_PHYSFS_FBUF_HPP_ */
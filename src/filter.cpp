@@ -0,0 +1,161 @@
+#include <deque>
+#include "filter.hpp"
+#include "fbuf.hpp"
+
+namespace PhysFS {
+
+void FilterChain::link::push(Chunk && chunk) {
+	if (index == chain->stages.size()) {
+		next->push(std::move(chunk));
+		return;
+	}
+	link after(chain, index + 1, next);
+	chain->stages[index]->push(std::move(chunk), after);
+}
+
+void FilterChain::push(Chunk && chunk, ChunkSink & next) {
+	link(this, 0, &next).push(std::move(chunk));
+}
+
+void FilterChain::finish(ChunkSink & next) {
+	for (std::size_t i = 0; i < stages.size(); i++) {
+		link after(this, i + 1, &next);
+		stages[i]->finish(after);
+	}
+}
+
+namespace {
+
+class queueSink : public ChunkSink {
+public:
+	void push(Chunk && chunk) {
+		if (!chunk.empty()) {
+			chunks.push_back(std::move(chunk));
+		}
+	}
+
+	std::deque<Chunk> chunks;
+};
+
+class fileSink : public ChunkSink {
+public:
+	fileSink(PHYSFS_File * file) : file(file), failed(false) {}
+
+	void push(Chunk && chunk) {
+		if (!chunk.empty() && PHYSFS_write(file, chunk.data(), chunk.size(), 1) < 1) {
+			failed = true;
+		}
+	}
+
+	PHYSFS_File * const file;
+	bool failed;
+};
+
+// Reads and writes whole chunks straight to and from PhysFS. The get area
+// points into the chunk the last stage produced, and the put area is the
+// chunk the first stage will receive, so no bytes are copied between stages.
+class chunkbuf : public peekbuf {
+private:
+	chunkbuf(const chunkbuf & other);
+	chunkbuf& operator=(const chunkbuf& other);
+
+	int_type underflow() {
+		if (gptr() < egptr()) {
+			return (unsigned char) *gptr();
+		}
+		while (input.chunks.empty()) {
+			if (finished) {
+				return traits_type::eof();
+			}
+			Chunk chunk(chunkSize);
+			PHYSFS_sint64 bytesRead = PHYSFS_read(file, chunk.data(), 1, chunkSize);
+			if (bytesRead < 1) {
+				filter->finish(input);
+				input.finish();
+				finished = true;
+				continue;
+			}
+			chunk.resize(bytesRead);
+			filter->push(std::move(chunk), input);
+		}
+		current = std::move(input.chunks.front());
+		input.chunks.pop_front();
+		setg(current.data(), current.data(), current.data() + current.size());
+		return (unsigned char) *gptr();
+	}
+
+	bool flushPending() {
+		if (pbase() == NULL) {
+			return !output.failed;
+		}
+		pending.resize(pptr() - pbase());
+		if (!pending.empty()) {
+			filter->push(std::move(pending), output);
+			pending = Chunk(chunkSize);
+		}
+		setp(pending.data(), pending.data() + pending.capacity());
+		return !output.failed;
+	}
+
+	int_type overflow(int_type c = traits_type::eof()) {
+		if (!flushPending()) {
+			return traits_type::eof();
+		}
+		if (c != traits_type::eof()) {
+			*pptr() = c;
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int sync() {
+		return flushPending() ? 0 : -1;
+	}
+
+	PHYSFS_File * const file;
+	std::unique_ptr<Filter> filter;
+	std::size_t const chunkSize;
+	queueSink input;
+	fileSink output;
+	Chunk current;
+	Chunk pending;
+	bool finished;
+	bool writing;
+public:
+	chunkbuf(PHYSFS_File * file, std::unique_ptr<Filter> filter, std::ios_base::openmode mode, std::size_t chunkSize = 64 * 1024)
+		: file(file), filter(std::move(filter)), chunkSize(chunkSize), output(file),
+		  finished(false), writing((mode & std::ios_base::out) != 0) {
+		if (writing) {
+			pending = Chunk(chunkSize);
+			setp(pending.data(), pending.data() + pending.capacity());
+		}
+	}
+
+	// a stage that fails here has nobody left to tell, as with fbuf
+	~chunkbuf() {
+		if (!writing) {
+			return;
+		}
+#ifndef PHYSFSPP_NO_EXCEPTIONS
+		try {
+#endif
+			flushPending();
+			filter->finish(output);
+			output.finish();
+#ifndef PHYSFSPP_NO_EXCEPTIONS
+		} catch (...) {
+		}
+#endif
+	}
+};
+
+}
+
+std::streambuf * filteringBuffer(PHYSFS_File * file, std::unique_ptr<Filter> filter, std::ios_base::openmode mode) {
+	if (!filter) {
+		filter.reset(new FilterChain());
+	}
+	return new chunkbuf(file, std::move(filter), mode);
+}
+
+}
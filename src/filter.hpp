@@ -0,0 +1,14 @@
+#ifndef _INCLUDE_PHYSFS_FILTER_BUFFER_HPP_
+#define _INCLUDE_PHYSFS_FILTER_BUFFER_HPP_
+
+#include <ios>
+#include <streambuf>
+#include "physfs_filter.hpp"
+
+namespace PhysFS {
+
+std::streambuf * filteringBuffer(PHYSFS_File * file, std::unique_ptr<Filter> filter, std::ios_base::openmode mode);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_FILTER_BUFFER_HPP_ */
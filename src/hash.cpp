@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PHYSFSPP_X86_CRC
+#include <immintrin.h>
+#endif
+#include "physfs_hash.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+uint32 read32(unsigned char const * p) {
+	uint32 value;
+	memcpy(&value, p, sizeof(value));
+	return PHYSFS_swapULE32(value);
+}
+
+uint64 read64(unsigned char const * p) {
+	uint64 value;
+	memcpy(&value, p, sizeof(value));
+	return PHYSFS_swapULE64(value);
+}
+
+// slicing-by-8 tables for a reflected polynomial
+class crcTable {
+public:
+	explicit crcTable(uint32 polynomial) {
+		for (uint32 i = 0; i < 256; i++) {
+			uint32 crc = i;
+			for (int bit = 0; bit < 8; bit++) {
+				crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+			}
+			table[0][i] = crc;
+		}
+		for (uint32 i = 0; i < 256; i++) {
+			for (int k = 1; k < 8; k++) {
+				table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+			}
+		}
+	}
+
+	uint32 update(uint32 crc, unsigned char const * p, std::size_t size) const {
+		while (size >= 8) {
+			uint32 one = read32(p) ^ crc;
+			uint32 two = read32(p + 4);
+			crc = table[7][one & 0xff] ^ table[6][(one >> 8) & 0xff]
+				^ table[5][(one >> 16) & 0xff] ^ table[4][one >> 24]
+				^ table[3][two & 0xff] ^ table[2][(two >> 8) & 0xff]
+				^ table[1][(two >> 16) & 0xff] ^ table[0][two >> 24];
+			p += 8;
+			size -= 8;
+		}
+		while (size-- > 0) {
+			crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		}
+		return crc;
+	}
+private:
+	uint32 table[8][256];
+};
+
+crcTable const & crc32Table() {
+	static crcTable const table(0xEDB88320);
+	return table;
+}
+
+crcTable const & crc32cTable() {
+	static crcTable const table(0x82F63B78);
+	return table;
+}
+
+#ifdef PHYSFSPP_X86_CRC
+bool hasSse42() {
+	static bool const supported = __builtin_cpu_supports("sse4.2");
+	return supported;
+}
+
+bool hasPclmul() {
+	static bool const supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+	return supported;
+}
+
+__attribute__((target("sse4.2")))
+uint32 crc32cSse42(uint32 crc, unsigned char const * p, std::size_t size) {
+	uint64 wide = crc;
+	while (size >= 8) {
+		uint64 value;
+		memcpy(&value, p, sizeof(value));
+		wide = _mm_crc32_u64(wide, value);
+		p += 8;
+		size -= 8;
+	}
+	crc = (uint32) wide;
+	while (size-- > 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+}
+
+__attribute__((target("pclmul,sse4.1")))
+__m128i fold(__m128i x, __m128i k, __m128i data) {
+	__m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+	__m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+	return _mm_xor_si128(_mm_xor_si128(low, high), data);
+}
+
+// Folds 64 bytes at a time with carry-less multiplies, then reduces to 32
+// bits with a Barrett reduction (Gopal et al., "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ"). Needs at least 64 bytes; only whole
+// 16-byte blocks are consumed and the rest is left to the caller.
+__attribute__((target("pclmul,sse4.1")))
+uint32 crc32Pclmul(uint32 crc, unsigned char const * & p, std::size_t & size) {
+	__m128i x1 = _mm_loadu_si128((__m128i const *) p);
+	__m128i x2 = _mm_loadu_si128((__m128i const *) (p + 16));
+	__m128i x3 = _mm_loadu_si128((__m128i const *) (p + 32));
+	__m128i x4 = _mm_loadu_si128((__m128i const *) (p + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	p += 64;
+	size -= 64;
+
+	__m128i k = _mm_set_epi64x(0x1c6e41596LL, 0x154442bd4LL);
+	while (size >= 64) {
+		x1 = fold(x1, k, _mm_loadu_si128((__m128i const *) p));
+		x2 = fold(x2, k, _mm_loadu_si128((__m128i const *) (p + 16)));
+		x3 = fold(x3, k, _mm_loadu_si128((__m128i const *) (p + 32)));
+		x4 = fold(x4, k, _mm_loadu_si128((__m128i const *) (p + 48)));
+		p += 64;
+		size -= 64;
+	}
+
+	k = _mm_set_epi64x(0x0ccaa009eLL, 0x1751997d0LL);
+	x1 = fold(x1, k, x2);
+	x1 = fold(x1, k, x3);
+	x1 = fold(x1, k, x4);
+	while (size >= 16) {
+		x1 = fold(x1, k, _mm_loadu_si128((__m128i const *) p));
+		p += 16;
+		size -= 16;
+	}
+
+	// 128 -> 64 bits
+	__m128i t = _mm_clmulepi64_si128(k, x1, 0x01);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+
+	// 64 -> 32 bits
+	__m128i mask = _mm_set_epi32(0, 0, 0, -1);
+	k = _mm_set_epi64x(0, 0x163cd6124LL);
+	t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), t);
+
+	// Barrett reduction
+	k = _mm_set_epi64x(0x1F7011641LL, 0x1DB710641LL);
+	t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+	t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), k, 0x00);
+	x1 = _mm_xor_si128(x1, t);
+	return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32 updateCrc32(uint32 crc, unsigned char const * p, std::size_t size) {
+#ifdef PHYSFSPP_X86_CRC
+	if (size >= 64 && hasPclmul()) {
+		crc = crc32Pclmul(crc, p, size);
+	}
+#endif
+	return crc32Table().update(crc, p, size);
+}
+
+uint32 updateCrc32c(uint32 crc, unsigned char const * p, std::size_t size) {
+#ifdef PHYSFSPP_X86_CRC
+	if (hasSse42()) {
+		return crc32cSse42(crc, p, size);
+	}
+#endif
+	return crc32cTable().update(crc, p, size);
+}
+
+uint64 const prime1 = 0x9E3779B185EBCA87ULL;
+uint64 const prime2 = 0xC2B2AE3D27D4EB4FULL;
+uint64 const prime3 = 0x165667B19E3779F9ULL;
+uint64 const prime4 = 0x85EBCA77C2B2AE63ULL;
+uint64 const prime5 = 0x27D4EB2F165667C5ULL;
+
+uint64 rotl(uint64 value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64 xxhRound(uint64 acc, uint64 input) {
+	acc += input * prime2;
+	return rotl(acc, 31) * prime1;
+}
+
+uint64 xxhMerge(uint64 acc, uint64 value) {
+	acc ^= xxhRound(0, value);
+	return acc * prime1 + prime4;
+}
+
+void xxhStripe(uint64 * state, unsigned char const * p) {
+	state[0] = xxhRound(state[0], read64(p));
+	state[1] = xxhRound(state[1], read64(p + 8));
+	state[2] = xxhRound(state[2], read64(p + 16));
+	state[3] = xxhRound(state[3], read64(p + 24));
+}
+
+std::size_t const readSize = 256 * 1024;
+
+}
+
+Hasher::Hasher(hashAlgorithm algorithm, uint64 seed) : algorithm(algorithm), seed(seed) {
+	reset();
+}
+
+void Hasher::reset() {
+	totalLength = 0;
+	tailSize = 0;
+	if (algorithm == XXH64) {
+		state[0] = seed + prime1 + prime2;
+		state[1] = seed + prime2;
+		state[2] = seed;
+		state[3] = seed - prime1;
+	} else {
+		state[0] = ~(uint32) seed;
+	}
+}
+
+hashAlgorithm Hasher::getAlgorithm() const {
+	return algorithm;
+}
+
+void Hasher::update(void const * data, std::size_t size) {
+	unsigned char const * p = (unsigned char const *) data;
+	totalLength += size;
+	switch (algorithm) {
+	case CRC32:
+		state[0] = updateCrc32((uint32) state[0], p, size);
+		return;
+	case CRC32C:
+		state[0] = updateCrc32c((uint32) state[0], p, size);
+		return;
+	case XXH64:
+		break;
+	}
+
+	if (tailSize + size < sizeof(tail)) {
+		memcpy(tail + tailSize, p, size);
+		tailSize += size;
+		return;
+	}
+	if (tailSize > 0) {
+		std::size_t fill = sizeof(tail) - tailSize;
+		memcpy(tail + tailSize, p, fill);
+		xxhStripe(state, tail);
+		p += fill;
+		size -= fill;
+		tailSize = 0;
+	}
+	while (size >= sizeof(tail)) {
+		xxhStripe(state, p);
+		p += sizeof(tail);
+		size -= sizeof(tail);
+	}
+	memcpy(tail, p, size);
+	tailSize = size;
+}
+
+uint64 Hasher::digest() const {
+	if (algorithm != XXH64) {
+		return ~(uint32) state[0];
+	}
+
+	uint64 hash;
+	if (totalLength >= sizeof(tail)) {
+		hash = rotl(state[0], 1) + rotl(state[1], 7) + rotl(state[2], 12) + rotl(state[3], 18);
+		for (int i = 0; i < 4; i++) {
+			hash = xxhMerge(hash, state[i]);
+		}
+	} else {
+		hash = seed + prime5;
+	}
+	hash += totalLength;
+
+	unsigned char const * p = tail;
+	std::size_t size = tailSize;
+	while (size >= 8) {
+		hash ^= xxhRound(0, read64(p));
+		hash = rotl(hash, 27) * prime1 + prime4;
+		p += 8;
+		size -= 8;
+	}
+	if (size >= 4) {
+		hash ^= (uint64) read32(p) * prime1;
+		hash = rotl(hash, 23) * prime2 + prime3;
+		p += 4;
+		size -= 4;
+	}
+	while (size-- > 0) {
+		hash ^= *p++ * prime5;
+		hash = rotl(hash, 11) * prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64 hashFile(string const & filename, hashAlgorithm algorithm) {
+	PHYSFS_File * file = openWithMode(filename.c_str(), READ);
+	Hasher hasher(algorithm);
+	std::vector<char> buffer(readSize);
+	PHYSFS_sint64 bytesRead;
+	while ((bytesRead = PHYSFS_read(file, &buffer[0], 1, buffer.size())) > 0) {
+		hasher.update(&buffer[0], bytesRead);
+	}
+	PHYSFS_close(file);
+	if (bytesRead < 0) {
+		PHYSFSPP_THROW(std::runtime_error("could not read " + filename));
+	}
+	return hasher.digest();
+}
+
+namespace {
+
+bool byPath(FileHash const & a, FileHash const & b) {
+	return a.path < b.path;
+}
+
+}
+
+FileHashList hashTree(string const & root, hashAlgorithm algorithm, unsigned threads) {
+	StringList files = listTree(root);
+	FileHashList hashes(files.size());
+	parallelFor(files.size(), threads, [&](std::size_t i) {
+		hashes[i].path = files[i];
+		hashes[i].hash = hashFile(files[i], algorithm);
+	});
+	std::sort(hashes.begin(), hashes.end(), byPath);
+	return hashes;
+}
+
+}
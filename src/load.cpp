@@ -0,0 +1,229 @@
+#include <new>
+#include <stdexcept>
+#include <string.h>
+#include "physfs_load.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+class alignedNew : public BufferAllocator {
+public:
+	void * allocate(std::size_t size, std::size_t alignment) {
+		return ::operator new(size, std::align_val_t(alignment));
+	}
+
+	void deallocate(void * memory, std::size_t, std::size_t alignment) {
+		::operator delete(memory, std::align_val_t(alignment));
+	}
+};
+
+// reads until length bytes are in or the file ends
+std::size_t readFully(PHYSFS_File * file, char * destination, std::size_t length, string const & filename) {
+	std::size_t total = 0;
+	while (total < length) {
+		PHYSFS_sint64 bytesRead = PHYSFS_read(file, destination + total, 1, length - total);
+		if (bytesRead < 0) {
+			PHYSFSPP_THROW(std::runtime_error("could not read " + filename));
+		}
+		if (bytesRead == 0) {
+			break;
+		}
+		total += bytesRead;
+	}
+	return total;
+}
+
+}
+
+BufferAllocator & defaultAllocator() {
+	static alignedNew allocator;
+	return allocator;
+}
+
+ReadOptions::ReadOptions() : alignmentBytes(alignof(std::max_align_t)), paddingBytes(0), source(&defaultAllocator()) {}
+
+ReadOptions & ReadOptions::alignment(std::size_t bytes) {
+	if (bytes == 0 || (bytes & (bytes - 1)) != 0) {
+		PHYSFSPP_THROW(std::invalid_argument("alignment must be a power of two"));
+	}
+	alignmentBytes = bytes;
+	return *this;
+}
+
+ReadOptions & ReadOptions::padding(std::size_t bytes) {
+	paddingBytes = bytes;
+	return *this;
+}
+
+ReadOptions & ReadOptions::allocator(BufferAllocator & source) {
+	this->source = &source;
+	return *this;
+}
+
+std::size_t ReadOptions::getAlignment() const {
+	return alignmentBytes;
+}
+
+std::size_t ReadOptions::getPadding() const {
+	return paddingBytes;
+}
+
+BufferAllocator & ReadOptions::getAllocator() const {
+	return *source;
+}
+
+Buffer::Buffer() : memory(NULL), length(0), capacity(0), alignment(0), source(NULL) {}
+
+Buffer::Buffer(std::size_t size, ReadOptions const & options)
+	: memory(NULL), length(size), capacity(size + options.getPadding()),
+	  alignment(options.getAlignment()), source(&options.getAllocator()) {
+	// never ask for zero bytes, so data() is always a real pointer
+	memory = (char *) source->allocate(capacity > 0 ? capacity : 1, alignment);
+	memset(memory + length, 0, capacity - length);
+}
+
+Buffer::Buffer(Buffer && other)
+	: memory(other.memory), length(other.length), capacity(other.capacity),
+	  alignment(other.alignment), source(other.source) {
+	other.memory = NULL;
+	other.length = other.capacity = 0;
+}
+
+Buffer& Buffer::operator=(Buffer && other) {
+	if (this != &other) {
+		release();
+		memory = other.memory;
+		length = other.length;
+		capacity = other.capacity;
+		alignment = other.alignment;
+		source = other.source;
+		other.memory = NULL;
+		other.length = other.capacity = 0;
+	}
+	return *this;
+}
+
+Buffer::~Buffer() {
+	release();
+}
+
+void Buffer::release() {
+	if (memory != NULL) {
+		source->deallocate(memory, capacity > 0 ? capacity : 1, alignment);
+		memory = NULL;
+	}
+}
+
+char * Buffer::data() {
+	return memory;
+}
+
+char const * Buffer::data() const {
+	return memory;
+}
+
+std::size_t Buffer::size() const {
+	return length;
+}
+
+std::size_t Buffer::padding() const {
+	return capacity - length;
+}
+
+bool Buffer::empty() const {
+	return length == 0;
+}
+
+std::string_view Buffer::view() const {
+	return std::string_view(memory, length);
+}
+
+void Buffer::truncate(std::size_t size) {
+	if (size < length) {
+		memset(memory + size, 0, length - size);
+		length = size;
+	}
+}
+
+Buffer readAll(string const & filename, ReadOptions const & options) {
+	fileHandle in(openWithMode(filename.c_str(), READ));
+	PHYSFS_sint64 fileLength = PHYSFS_fileLength(in.file);
+	if (fileLength >= 0) {
+		Buffer contents(fileLength, options);
+		contents.truncate(readFully(in.file, contents.data(), contents.size(), filename));
+		return contents;
+	}
+	// length unknown: grow by doubling, copying what was read so far
+	Buffer contents(64 * 1024, options);
+	std::size_t total = 0;
+	for (;;) {
+		total += readFully(in.file, contents.data() + total, contents.size() - total, filename);
+		if (total < contents.size()) {
+			break;
+		}
+		Buffer larger(contents.size() * 2, options);
+		memcpy(larger.data(), contents.data(), total);
+		contents = std::move(larger);
+	}
+	contents.truncate(total);
+	return contents;
+}
+
+Buffer readRange(string const & filename, uint64 offset, std::size_t length, ReadOptions const & options) {
+	fileHandle in(openWithMode(filename.c_str(), READ));
+	PHYSFS_sint64 fileLength = PHYSFS_fileLength(in.file);
+	if (fileLength >= 0) {
+		uint64 available = (uint64) fileLength > offset ? fileLength - offset : 0;
+		if (available < length) {
+			length = available;
+		}
+	}
+	Buffer contents(length, options);
+	if (length > 0) {
+		if (!PHYSFS_seek(in.file, offset)) {
+			PHYSFSPP_THROW(std::runtime_error("could not seek in " + filename));
+		}
+		contents.truncate(readFully(in.file, contents.data(), length, filename));
+	}
+	return contents;
+}
+
+LoadedFiles loadManyContiguous(StringList const & paths, ReadOptions const & options, unsigned threads) {
+	std::vector<uint64> lengths(paths.size());
+	parallelFor(paths.size(), threads, [&](std::size_t i) {
+		fileHandle in(openWithMode(paths[i].c_str(), READ));
+		PHYSFS_sint64 length = PHYSFS_fileLength(in.file);
+		if (length < 0) {
+			PHYSFSPP_THROW(std::runtime_error("could not find the length of " + paths[i]));
+		}
+		lengths[i] = length;
+	});
+
+	std::size_t const alignment = options.getAlignment();
+	std::vector<std::size_t> offsets(paths.size());
+	std::size_t total = 0;
+	for (std::size_t i = 0; i < paths.size(); i++) {
+		offsets[i] = total;
+		total += (lengths[i] + options.getPadding() + alignment - 1) & ~(alignment - 1);
+	}
+
+	LoadedFiles loaded;
+	loaded.arena = Buffer(total, ReadOptions(options).padding(0));
+	loaded.files.resize(paths.size());
+	char * arena = loaded.arena.data();
+	parallelFor(paths.size(), threads, [&](std::size_t i) {
+		fileHandle in(openWithMode(paths[i].c_str(), READ));
+		char * slot = arena + offsets[i];
+		std::size_t slotSize = (i + 1 < paths.size() ? offsets[i + 1] : total) - offsets[i];
+		std::size_t length = readFully(in.file, slot, lengths[i], paths[i]);
+		memset(slot + length, 0, slotSize - length);
+		loaded.files[i].path = paths[i];
+		loaded.files[i].contents = std::string_view(slot, length);
+	});
+	return loaded;
+}
+
+}
@@ -0,0 +1,334 @@
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include "physfs_memdir.hpp"
+#include "physfs_budget.hpp"
+#include "physfs_tree.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+typedef std::shared_ptr<string const> contents;
+
+std::chrono::milliseconds const retryDelay(1000);
+
+// true if path is known not to be in the write dir
+bool isGone(string const & path) {
+	string native = writeDirPath(path);
+	std::error_code error;
+	return !native.empty() && !std::filesystem::exists(std::filesystem::symlink_status(native, error));
+}
+
+// reads straight out of a published file, which never changes once shared
+class memoryInbuf : public std::streambuf {
+private:
+	contents data;
+
+	pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode) {
+		off_type from = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? gptr() - eback() : egptr() - eback();
+		if (from + offset < 0 || from + offset > egptr() - eback()) {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), eback() + from + offset, egptr());
+		return from + offset;
+	}
+
+	pos_type seekpos(pos_type target, std::ios_base::openmode mode) {
+		return seekoff(off_type(target), std::ios_base::beg, mode);
+	}
+public:
+	memoryInbuf(contents const & data) : data(data) {
+		char * begin = const_cast<char *>(data->data());
+		setg(begin, begin, begin + data->size());
+	}
+};
+
+class memoryInStream : public std::istream {
+public:
+	memoryInStream(contents const & data) : std::istream(new memoryInbuf(data)) {}
+
+	~memoryInStream() {
+		delete rdbuf();
+	}
+};
+
+// collects a file and publishes it on destruction; flushing the stream does
+// nothing, as copying the whole file out each time would make std::endl
+// quadratic
+class memoryOutbuf : public std::streambuf {
+public:
+	typedef std::function<void(contents const &)> publisher;
+private:
+	publisher const publish;
+	string data;
+
+	int_type overflow(int_type c = traits_type::eof()) {
+		if (c != traits_type::eof()) {
+			data.push_back(traits_type::to_char_type(c));
+		}
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize xsputn(char const * source, std::streamsize count) {
+		data.append(source, count);
+		return count;
+	}
+
+public:
+	memoryOutbuf(publisher const & publish, string const & initial) : publish(publish), data(initial) {}
+
+	~memoryOutbuf() {
+		publish(contents(new string(std::move(data))));
+	}
+};
+
+class memoryOutStream : public std::ostream {
+public:
+	memoryOutStream(memoryOutbuf * buffer) : std::ostream(buffer) {}
+
+	~memoryOutStream() {
+		delete rdbuf();
+	}
+};
+
+}
+
+class MemoryWriteDir::State {
+public:
+	struct entry {
+		// NULL once deleted
+		contents data;
+	};
+
+	std::size_t const memoryLimit;
+	std::chrono::milliseconds const interval;
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	std::mutex flushing;
+	std::map<string, entry> files;
+	std::set<string> directories;
+	std::size_t pending;
+	bool stopping;
+	std::thread thread;
+
+	State(std::size_t memoryLimit, unsigned intervalMilliseconds)
+		: memoryLimit(memoryLimit), interval(intervalMilliseconds), pending(0), stopping(false) {}
+
+	// callers hold lock
+	void replace(string const & path, contents const & data) {
+		std::map<string, entry>::iterator existing = files.find(path);
+		if (existing != files.end() && existing->second.data) {
+			pending -= existing->second.data->size();
+		}
+		files[path].data = data;
+		if (data) {
+			pending += data->size();
+		}
+		if (pending > memoryLimit) {
+			wake.notify_one();
+		}
+	}
+
+	void publish(string const & path, contents const & data) {
+		std::unique_lock<std::mutex> guard(lock);
+		replace(path, data);
+		if (stopping) {
+			// the MemoryWriteDir is gone, or going, and will not flush again
+			guard.unlock();
+			flush();
+		}
+	}
+
+	bool flush() {
+		std::lock_guard<std::mutex> serial(flushing);
+		std::map<string, entry> batch;
+		std::set<string> created;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			batch = files;
+			created.swap(directories);
+		}
+		bool succeeded = true;
+		std::set<string> failedDirectories;
+		for (std::set<string>::const_iterator dir = created.begin(); dir != created.end(); ++dir) {
+			if (!mkdirs(*dir)) {
+				failedDirectories.insert(*dir);
+			}
+		}
+		std::set<string> done;
+		for (std::map<string, entry>::const_iterator file = batch.begin(); file != batch.end(); ++file) {
+			if (!file->second.data) {
+				forgetDirectories(file->first);
+				// deleting what was never written out fails too, and that is fine
+				if (PHYSFS_delete(file->first.c_str()) || isGone(file->first)) {
+					done.insert(file->first);
+				}
+				continue;
+			}
+			string parent = file->first.substr(0, file->first.rfind('/') == string::npos ? 0 : file->first.rfind('/'));
+			mkdirs(parent);
+			PHYSFS_File * out = tryOpenWithMode(file->first.c_str(), WRITE);
+			if (out == NULL) {
+				continue;
+			}
+			contents const & data = file->second.data;
+			bool written = data->empty() || PHYSFS_write(out, data->data(), data->size(), 1) == 1;
+			if (PHYSFS_close(out) && written) {
+				done.insert(file->first);
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		directories.insert(failedDirectories.begin(), failedDirectories.end());
+		for (std::map<string, entry>::const_iterator file = batch.begin(); file != batch.end(); ++file) {
+			std::map<string, entry>::iterator current = files.find(file->first);
+			if (done.count(file->first) == 0) {
+				succeeded = false;
+			} else if (current != files.end() && current->second.data == file->second.data) {
+				// unchanged while it was written out
+				if (current->second.data) {
+					pending -= current->second.data->size();
+				}
+				files.erase(current);
+			}
+		}
+		return succeeded && failedDirectories.empty();
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> guard(lock);
+		bool retrying = false;
+		while (!stopping) {
+			// after a failure, wait out the retry delay even if still over the limit
+			auto due = [this, retrying] {
+				return stopping || (!retrying && pending > memoryLimit);
+			};
+			if (retrying) {
+				wake.wait_for(guard, interval.count() > 0 ? interval : retryDelay, due);
+			} else if (interval.count() > 0) {
+				wake.wait_for(guard, interval, due);
+			} else {
+				wake.wait(guard, due);
+			}
+			if (stopping) {
+				break;
+			}
+			guard.unlock();
+			retrying = !flush();
+			guard.lock();
+		}
+	}
+};
+
+MemoryWriteDir::MemoryWriteDir(std::size_t memoryLimit, unsigned flushIntervalMilliseconds)
+	: state(new State(memoryLimit, flushIntervalMilliseconds)) {
+	state->thread = std::thread(&State::run, state.get());
+	std::shared_ptr<State> flushed = state;
+	// giving memory back means writing it to disk, the dearest way there is
+	budgetId = MemoryBudget::global().add(100, [flushed] {
+		std::lock_guard<std::mutex> guard(flushed->lock);
+		return flushed->pending;
+	}, [flushed](std::size_t) {
+		std::unique_lock<std::mutex> guard(flushed->lock);
+		std::size_t before = flushed->pending;
+		guard.unlock();
+		flushed->flush();
+		guard.lock();
+		return before > flushed->pending ? before - flushed->pending : 0;
+	});
+}
+
+MemoryWriteDir::~MemoryWriteDir() {
+	MemoryBudget::global().remove(budgetId);
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		state->stopping = true;
+	}
+	state->wake.notify_one();
+	state->thread.join();
+	state->flush();
+}
+
+bool MemoryWriteDir::mkdir(string const & dirName) {
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->directories.insert(normalizePath(dirName));
+	return true;
+}
+
+bool MemoryWriteDir::deleteFile(string const & filename) {
+	string path = normalizePath(filename);
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->directories.erase(path);
+	state->replace(path, contents());
+	return true;
+}
+
+std::unique_ptr<std::ostream> MemoryWriteDir::openWrite(string const & filename, mode writeMode) {
+	if (writeMode == READ) {
+		PHYSFSPP_THROW(std::invalid_argument("openWrite needs WRITE or APPEND"));
+	}
+	string path = normalizePath(filename);
+	string initial;
+	if (writeMode == APPEND) {
+		std::unique_ptr<std::istream> existing;
+		if (exists(path)) {
+			existing = openRead(path);
+			initial.assign(std::istreambuf_iterator<char>(*existing), std::istreambuf_iterator<char>());
+		}
+	}
+	std::shared_ptr<State> owner = state;
+	memoryOutbuf::publisher publish = [owner, path](contents const & data) {
+		owner->publish(path, data);
+	};
+	return std::unique_ptr<std::ostream>(new memoryOutStream(new memoryOutbuf(publish, initial)));
+}
+
+std::unique_ptr<std::istream> MemoryWriteDir::openRead(string const & filename) {
+	string path = normalizePath(filename);
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		std::map<string, State::entry>::const_iterator found = state->files.find(path);
+		if (found != state->files.end()) {
+			if (!found->second.data) {
+				PHYSFSPP_THROW(std::invalid_argument("file not found: " + filename));
+			}
+			return std::unique_ptr<std::istream>(new memoryInStream(found->second.data));
+		}
+	}
+	return std::unique_ptr<std::istream>(new ifstream(path));
+}
+
+bool MemoryWriteDir::exists(string const & filename) const {
+	string path = normalizePath(filename);
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		std::map<string, State::entry>::const_iterator found = state->files.find(path);
+		if (found != state->files.end()) {
+			return found->second.data.get() != NULL;
+		}
+		if (state->directories.count(path) != 0) {
+			return true;
+		}
+	}
+	return PhysFS::exists(path);
+}
+
+bool MemoryWriteDir::flush() {
+	return state->flush();
+}
+
+std::size_t MemoryWriteDir::pendingBytes() const {
+	std::lock_guard<std::mutex> guard(state->lock);
+	return state->pending;
+}
+
+}
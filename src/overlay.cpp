@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+#include "physfs_overlay.hpp"
+#include "physfs_tree.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+string const lengthFile = "length";
+
+// shadow files are read natively, as the write dir need not be mounted
+bool readShadow(string const & filename, char * destination, std::size_t capacity, std::size_t & bytesRead) {
+	string native = writeDirPath(filename);
+	FILE * in = native.empty() ? NULL : fopen(native.c_str(), "rb");
+	if (in == NULL) {
+		return false;
+	}
+	bytesRead = fread(destination, 1, capacity, in);
+	fclose(in);
+	return true;
+}
+
+bool readShadowLength(string const & dir, sint64 & length) {
+	char text[32];
+	std::size_t bytesRead = 0;
+	if (!readShadow(joinPath(dir, lengthFile), text, sizeof(text) - 1, bytesRead)) {
+		return false;
+	}
+	text[bytesRead] = '\0';
+	length = strtoll(text, NULL, 10);
+	return true;
+}
+
+// false, with PHYSFS_getLastError() set, if the shadow could not be written
+bool writeShadow(string const & filename, char const * data, std::size_t size) {
+	PHYSFS_File * file = tryOpenWithMode(filename.c_str(), WRITE);
+	if (file == NULL) {
+		return false;
+	}
+	fileHandle out(file);
+	return size == 0 || PHYSFS_write(out.file, data, size, 1) == 1;
+}
+
+// One chunk of the file is held at a time. The get area covers its valid
+// bytes while reading and the put area the rest of it while writing; settle()
+// folds either back into position before switching.
+class overlaybuf : public std::streambuf {
+private:
+	overlaybuf(const overlaybuf & other);
+	overlaybuf& operator=(const overlaybuf& other);
+
+	string const dir;
+	std::size_t const chunkSize;
+	PHYSFS_File * base;
+	sint64 baseLength;
+	sint64 length;
+	sint64 position;
+	std::vector<char> chunk;
+	sint64 chunkIndex;
+	std::size_t valid;
+	bool dirty;
+	bool lengthDirty;
+	// whether the length file exists, which is what marks a file shadowed
+	bool shadowed;
+
+	sint64 chunkStart() const {
+		return chunkIndex * (sint64) chunkSize;
+	}
+
+	void settle() {
+		if (pbase() != NULL) {
+			if (pptr() > pbase()) {
+				std::size_t end = pptr() - chunk.data();
+				valid = end > valid ? end : valid;
+				dirty = true;
+				if (chunkStart() + (sint64) valid > length) {
+					length = chunkStart() + valid;
+					lengthDirty = true;
+				}
+			}
+			position = chunkStart() + (pptr() - chunk.data());
+			setp(NULL, NULL);
+		}
+		if (eback() != NULL) {
+			position = chunkStart() + (gptr() - chunk.data());
+			setg(NULL, NULL, NULL);
+		}
+	}
+
+	bool load(sint64 index) {
+		if (index == chunkIndex) {
+			return true;
+		}
+		if (!save()) {
+			return false;
+		}
+		chunkIndex = index;
+		std::fill(chunk.begin(), chunk.end(), 0);
+		std::size_t bytesRead = 0;
+		if (!readShadow(joinPath(dir, std::to_string(index)), chunk.data(), chunkSize, bytesRead) && base != NULL
+				&& chunkStart() < baseLength) {
+			PHYSFS_seek(base, chunkStart());
+			PHYSFS_sint64 got = PHYSFS_read(base, chunk.data(), 1, chunkSize);
+			bytesRead = got > 0 ? got : 0;
+		}
+		sint64 left = length - chunkStart();
+		valid = left <= 0 ? 0 : left < (sint64) chunkSize ? left : chunkSize;
+		return true;
+	}
+
+	// false if a shadow could not be written; it stays dirty for next time
+	bool save() {
+		if (dirty) {
+			if (!mkdirs(dir) || !writeShadow(joinPath(dir, std::to_string(chunkIndex)), chunk.data(), valid)) {
+				return false;
+			}
+			dirty = false;
+			// the first chunk written makes the file shadowed, even if its
+			// length has not changed
+			lengthDirty = lengthDirty || !shadowed;
+		}
+		if (lengthDirty) {
+			string text = std::to_string(length);
+			if (!mkdirs(dir) || !writeShadow(joinPath(dir, lengthFile), text.data(), text.size())) {
+				return false;
+			}
+			lengthDirty = false;
+			shadowed = true;
+		}
+		return true;
+	}
+
+	int_type underflow() {
+		settle();
+		if (position >= length) {
+			return traits_type::eof();
+		}
+		if (!load(position / chunkSize)) {
+			return traits_type::eof();
+		}
+		char * begin = chunk.data();
+		setg(begin, begin + (position - chunkStart()), begin + valid);
+		return (unsigned char) *gptr();
+	}
+
+	int_type overflow(int_type c = traits_type::eof()) {
+		settle();
+		if (!load(position / chunkSize)) {
+			return traits_type::eof();
+		}
+		char * begin = chunk.data();
+		setp(begin + (position - chunkStart()), begin + chunkSize);
+		if (c != traits_type::eof()) {
+			*pptr() = c;
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode) {
+		settle();
+		sint64 from = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? position : length;
+		if (from + offset < 0) {
+			return pos_type(off_type(-1));
+		}
+		position = from + offset;
+		return position;
+	}
+
+	pos_type seekpos(pos_type target, std::ios_base::openmode mode) {
+		return seekoff(off_type(target), std::ios_base::beg, mode);
+	}
+
+	int sync() {
+		settle();
+		return save() ? 0 : -1;
+	}
+public:
+	overlaybuf(string const & path, string const & dir, std::size_t chunkSize)
+		: dir(dir), chunkSize(chunkSize), base(tryOpenWithMode(path.c_str(), READ)),
+		  baseLength(base != NULL ? PHYSFS_fileLength(base) : 0), length(0), position(0),
+		  chunk(chunkSize), chunkIndex(-1), valid(0), dirty(false), lengthDirty(false), shadowed(false) {
+		shadowed = readShadowLength(dir, length);
+		if (!shadowed) {
+			length = baseLength;
+		}
+	}
+
+	// a failed save is lost here, as with fbuf; flush the stream first to
+	// see it
+	~overlaybuf() {
+		sync();
+		if (base != NULL) {
+			PHYSFS_close(base);
+		}
+	}
+};
+
+class overlayStream : public std::iostream {
+public:
+	overlayStream(overlaybuf * buffer) : std::iostream(buffer) {}
+
+	~overlayStream() {
+		delete rdbuf();
+	}
+};
+
+}
+
+Overlay::Overlay(string const & shadowRoot, std::size_t chunkSize)
+	: shadowRoot(normalizePath(shadowRoot)), chunkSize(chunkSize > 0 ? chunkSize : 1) {}
+
+string Overlay::shadowDir(string const & path) const {
+	return joinPath(shadowRoot, normalizePath(path) + ".chunks");
+}
+
+std::unique_ptr<std::iostream> Overlay::openUpdate(string const & path) const {
+	if (writeDirPath("").empty()) {
+		PHYSFSPP_THROW(std::invalid_argument("no write dir to keep shadows in"));
+	}
+	return std::unique_ptr<std::iostream>(new overlayStream(new overlaybuf(normalizePath(path), shadowDir(path), chunkSize)));
+}
+
+std::unique_ptr<std::istream> Overlay::openRead(string const & path) const {
+	if (isShadowed(path)) {
+		return openUpdate(path);
+	}
+	return std::unique_ptr<std::istream>(new ifstream(path));
+}
+
+bool Overlay::isShadowed(string const & path) const {
+	sint64 length;
+	return readShadowLength(shadowDir(path), length);
+}
+
+void Overlay::discard(string const & path) const {
+	string dir = shadowDir(path);
+	sint64 length = 0;
+	if (!readShadowLength(dir, length)) {
+		return;
+	}
+	for (sint64 index = 0; index * (sint64) chunkSize < length; index++) {
+		PHYSFS_delete(joinPath(dir, std::to_string(index)).c_str());
+	}
+	PHYSFS_delete(joinPath(dir, lengthFile).c_str());
+	PHYSFS_delete(dir.c_str());
+	forgetDirectories(dir);
+}
+
+string const & Overlay::getShadowRoot() const {
+	return shadowRoot;
+}
+
+std::size_t Overlay::getChunkSize() const {
+	return chunkSize;
+}
+
+}
@@ -1,108 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
 #include <streambuf>
 #include <string>
 #include <string.h>
 #include <stdexcept>
 #include "physfs.hpp"
+#include "fbuf.hpp"
+#include "compress.hpp"
+#include "filter.hpp"
+#include "tree.hpp"
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using std::streambuf;
 using std::ios_base;
 
 namespace PhysFS {
 
-class fbuf : public streambuf {
-private:
-	fbuf(const fbuf & other);
-	fbuf& operator=(const fbuf& other);
+namespace {
 
-	int_type underflow() {
-		if (PHYSFS_eof(file)) {
-			return traits_type::eof();
-		}
-		size_t bytesRead = PHYSFS_read(file, buffer, 1, bufferSize);
-		if (bytesRead < 1) {
-			return traits_type::eof();
-		}
-		setg(buffer, buffer, buffer + bytesRead);
-		return (unsigned char) *gptr();
-	}
+Error lastError() {
+	char const * message = PHYSFS_getLastError();
+	return Error(message != NULL ? message : "unknown error");
+}
 
-	pos_type seekoff(off_type pos, ios_base::seekdir dir, ios_base::openmode mode) {
-		switch (dir) {
-		case std::ios_base::beg:
-			PHYSFS_seek(file, pos);
-			break;
-		case std::ios_base::cur:
-			// subtract characters currently in buffer from seek position
-			PHYSFS_seek(file, (PHYSFS_tell(file) + pos) - (egptr() - gptr()));
-			break;
-		case std::ios_base::end:
-			PHYSFS_seek(file, PHYSFS_fileLength(file) + pos);
-			break;
-		}
-		if (mode & std::ios_base::in) {
-			setg(egptr(), egptr(), egptr());
-		}
-		if (mode & std::ios_base::out) {
-			setp(buffer, buffer);
-		}
-		return PHYSFS_tell(file);
+Result<void> check(int status) {
+	if (status == 0) {
+		return lastError();
 	}
+	return Result<void>();
+}
 
-	pos_type seekpos(pos_type pos, std::ios_base::openmode mode) {
-		PHYSFS_seek(file, pos);
-		if (mode & std::ios_base::in) {
-			setg(egptr(), egptr(), egptr());
-		}
-		if (mode & std::ios_base::out) {
-			setp(buffer, buffer);
-		}
-		return PHYSFS_tell(file);
-	}
+std::string_view view(char const * value) {
+	return value != NULL ? std::string_view(value) : std::string_view();
+}
 
-	int_type overflow( int_type c = traits_type::eof() ) {
-		if (pptr() == pbase() && c == traits_type::eof()) {
-			return 0; // no-op
-		}
-		if (PHYSFS_write(file, pbase(), pptr() - pbase(), 1) < 1) {
-			return traits_type::eof();
-		}
-		if (c != traits_type::eof()) {
-			if (PHYSFS_write(file, &c, 1, 1) < 1) {
-				return traits_type::eof();
-			}
-		}
+std::shared_ptr<ConfigDirs const> configDirs;
 
-		return 0;
-	}
+void refreshConfigDirs() {
+	std::shared_ptr<ConfigDirs> dirs(new ConfigDirs());
+	dirs->baseDir = getBaseDirView();
+	dirs->userDir = getUserDirView();
+	dirs->writeDir = getWriteDirView();
+	dirs->dirSeparator = getDirSeparatorView();
+	std::atomic_store(&configDirs, std::shared_ptr<ConfigDirs const>(dirs));
+}
 
-	int sync() {
-		return overflow();
-	}
+}
 
-	char * buffer;
-	size_t const bufferSize;
-protected:
-	PHYSFS_File * const file;
-public:
-	fbuf(PHYSFS_File * file, std::size_t bufferSize = 2048) : file(file), bufferSize(bufferSize) {
-		buffer = new char[bufferSize];
-		char * end = buffer + bufferSize;
-		setg(end, end, end);
-		setp(buffer, end);
-	}
+void abortWith(char const * message) {
+	fprintf(stderr, "physfs++: %s\n", message);
+	std::abort();
+}
 
-	~fbuf() {
-		sync();
-		delete [] buffer;
-	}
-};
+Error::Error() {}
+
+Error::Error(string const & message) : message(message) {}
+
+string const & Error::getMessage() const {
+	return message;
+}
 
 base_fstream::base_fstream(PHYSFS_File* file) : file(file) {
     if (file == NULL) {
-        throw std::invalid_argument("attempted to construct fstream with NULL ptr");
+        PHYSFSPP_THROW(std::invalid_argument("attempted to construct fstream with NULL ptr"));
     }
 }
 
+base_fstream::base_fstream(const string& filename, mode openMode)
+	: file(openWithMode(filename.c_str(), openMode)) {}
+
 base_fstream::~base_fstream() {
 	PHYSFS_close(file);
 }
@@ -112,6 +82,14 @@ PhysFS::size_t base_fstream::length() {
 }
 
 PHYSFS_File* openWithMode(char const * filename, mode openMode) {
+    PHYSFS_File* file = tryOpenWithMode(filename, openMode);
+    if (file == NULL) {
+        PHYSFSPP_THROW(std::invalid_argument("file not found: " + std::string(filename)));
+    }
+    return file;
+}
+
+PHYSFS_File* tryOpenWithMode(char const * filename, mode openMode) {
     PHYSFS_File* file = NULL;
 	switch (openMode) {
 	case WRITE:
@@ -123,33 +101,147 @@ PHYSFS_File* openWithMode(char const * filename, mode openMode) {
 	case READ:
 		file = PHYSFS_openRead(filename);
 	}
-    if (file == NULL) {
-        throw std::invalid_argument("file not found: " + std::string(filename));
-    }
     return file;
 }
 
+nativeHints::nativeHints(string const & path) : path(path), fd(-1), opened(false) {}
+
+nativeHints::~nativeHints() {
+#if defined(POSIX_FADV_WILLNEED)
+	if (fd >= 0) {
+		close(fd);
+	}
+#endif
+}
+
+void nativeHints::willNeed(sint64 offset, sint64 length) {
+#if defined(POSIX_FADV_WILLNEED)
+	if (!opened) {
+		opened = true;
+		string native = nativePath(path);
+		if (!native.empty()) {
+			fd = open(native.c_str(), O_RDONLY | O_CLOEXEC);
+		}
+	}
+	if (fd >= 0) {
+		posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+	}
+#else
+	(void) offset;
+	(void) length;
+#endif
+}
+
 ifstream::ifstream(const string& filename)
-	: base_fstream(openWithMode(filename.c_str(), READ)), std::istream(new fbuf(file)) {}
+	: base_fstream(openWithMode(filename.c_str(), READ)), std::istream(new fbuf(file, filename)) {}
+
+ifstream::ifstream(const string& filename, const Compress& compression)
+	: base_fstream(openWithMode(filename.c_str(), READ)), std::istream(decompressingBuffer(file, compression)) {}
+
+ifstream::ifstream(const string& filename, std::unique_ptr<Filter> filter)
+	: base_fstream(openWithMode(filename.c_str(), READ)), std::istream(filteringBuffer(file, std::move(filter), std::ios_base::in)) {}
+
+ifstream::ifstream(PHYSFS_File * file, const string& filename)
+	: base_fstream(file), std::istream(new fbuf(file, filename)) {}
 
 ifstream::~ifstream() {
 	delete rdbuf();
 }
 
+Result<std::unique_ptr<ifstream> > ifstream::open(const string& filename) {
+	PHYSFS_File * file = tryOpenWithMode(filename.c_str(), READ);
+	if (file == NULL) {
+		return lastError();
+	}
+	return std::unique_ptr<ifstream>(new ifstream(file, filename));
+}
+
+std::string_view ifstream::contiguous() {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->contiguous() : std::string_view();
+}
+
+std::string_view ifstream::peek(std::size_t count) {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->peek(count) : std::string_view();
+}
+
+void ifstream::consume(std::size_t count) {
+	peekbuf * buffer = peekable(rdbuf());
+	if (buffer != NULL) {
+		buffer->consume(count);
+	}
+}
+
+sint64 ifstream::remaining() {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->remaining() : -1;
+}
+
 ofstream::ofstream(const string& filename, mode writeMode)
 	: base_fstream(openWithMode(filename.c_str(), writeMode)), std::ostream(new fbuf(file)) {}
 
+ofstream::ofstream(const string& filename, mode writeMode, const Compress& compression)
+	: base_fstream(openWithMode(filename.c_str(), writeMode)), std::ostream(compressingBuffer(file, compression)) {}
+
+ofstream::ofstream(const string& filename, mode writeMode, std::unique_ptr<Filter> filter)
+	: base_fstream(openWithMode(filename.c_str(), writeMode)), std::ostream(filteringBuffer(file, std::move(filter), std::ios_base::out)) {}
+
+ofstream::ofstream(PHYSFS_File * file)
+	: base_fstream(file), std::ostream(new fbuf(file)) {}
+
 ofstream::~ofstream() {
 	delete rdbuf();
 }
 
+Result<std::unique_ptr<ofstream> > ofstream::open(const string& filename, mode writeMode) {
+	PHYSFS_File * file = tryOpenWithMode(filename.c_str(), writeMode);
+	if (file == NULL) {
+		return lastError();
+	}
+	return std::unique_ptr<ofstream>(new ofstream(file));
+}
+
 fstream::fstream(const string& filename, mode openMode)
 	: base_fstream(openWithMode(filename.c_str(), openMode)), std::iostream(new fbuf(file)) {}
 
+fstream::fstream(PHYSFS_File * file)
+	: base_fstream(file), std::iostream(new fbuf(file)) {}
+
 fstream::~fstream() {
 	delete rdbuf();
 }
 
+Result<std::unique_ptr<fstream> > fstream::open(const string& filename, mode openMode) {
+	PHYSFS_File * file = tryOpenWithMode(filename.c_str(), openMode);
+	if (file == NULL) {
+		return lastError();
+	}
+	return std::unique_ptr<fstream>(new fstream(file));
+}
+
+std::string_view fstream::contiguous() {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->contiguous() : std::string_view();
+}
+
+std::string_view fstream::peek(std::size_t count) {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->peek(count) : std::string_view();
+}
+
+void fstream::consume(std::size_t count) {
+	peekbuf * buffer = peekable(rdbuf());
+	if (buffer != NULL) {
+		buffer->consume(count);
+	}
+}
+
+sint64 fstream::remaining() {
+	peekbuf * buffer = peekable(rdbuf());
+	return buffer != NULL ? buffer->remaining() : -1;
+}
+
 Version getLinkedVersion() {
 	Version version;
 	PHYSFS_getLinkedVersion(&version);
@@ -157,11 +249,11 @@ Version getLinkedVersion() {
 }
 
 void init(const char* argv0) {
-	PHYSFS_init(argv0);
+	tryInit(argv0);
 }
 
 void deinit() {
-	PHYSFS_deinit();
+	tryDeinit();
 }
 
 ArchiveInfoList supportedArchiveTypes() {
@@ -173,7 +265,7 @@ ArchiveInfoList supportedArchiveTypes() {
 }
 
 string getDirSeparator() {
-	return PHYSFS_getDirSeparator();
+	return string(getDirSeparatorView());
 }
 
 void permitSymbolicLinks(bool allow) {
@@ -195,23 +287,23 @@ void getCdRomDirs(StringCallback callback, void * extra) {
 }
 
 string getBaseDir() {
-	return PHYSFS_getBaseDir();
+	return string(getBaseDirView());
 }
 
 string getUserDir() {
-	return PHYSFS_getUserDir();
+	return string(getUserDirView());
 }
 
 string getWriteDir() {
-	return PHYSFS_getWriteDir();
+	return string(getWriteDirView());
 }
 
 void setWriteDir(const string& newDir) {
-	PHYSFS_setWriteDir(newDir.c_str());
+	trySetWriteDir(newDir);
 }
 
 void removeFromSearchPath(const string& oldDir) {
-	PHYSFS_removeFromSearchPath(oldDir.c_str());
+	tryRemoveFromSearchPath(oldDir);
 }
 
 StringList getSearchPath() {
@@ -230,19 +322,19 @@ void getSearchPath(StringCallback callback, void * extra) {
 
 void setSaneConfig(const string& orgName, const string& appName,
 		const string& archiveExt, bool includeCdRoms, bool archivesFirst) {
-	PHYSFS_setSaneConfig(orgName.c_str(), appName.c_str(), archiveExt.c_str(), includeCdRoms, archivesFirst);
+	trySetSaneConfig(orgName, appName, archiveExt, includeCdRoms, archivesFirst);
 }
 
 void mkdir(const string& dirName) {
-	PHYSFS_mkdir(dirName.c_str());
+	tryMkdir(dirName);
 }
 
 void deleteFile(const string& filename) {
-	PHYSFS_delete(filename.c_str());
+	tryDeleteFile(filename);
 }
 
 string getRealDir(const string& filename) {
-	return PHYSFS_getRealDir(filename.c_str());
+	return string(getRealDirView(filename));
 }
 
 StringList enumerateFiles(const string& directory) {
@@ -288,11 +380,105 @@ void setAllocator(const Allocator* allocator) {
 }
 
 void mount(const string& newDir, const string& mountPoint, bool appendToPath) {
-	PHYSFS_mount(newDir.c_str(), mountPoint.c_str(), appendToPath);
+	tryMount(newDir, mountPoint, appendToPath);
 }
 
 string getMountPoint(const string& dir) {
-	return PHYSFS_getMountPoint(dir.c_str());
+	return string(getMountPointView(dir));
+}
+
+std::string_view getDirSeparatorView() {
+	return view(PHYSFS_getDirSeparator());
+}
+
+std::string_view getBaseDirView() {
+	return view(PHYSFS_getBaseDir());
+}
+
+std::string_view getUserDirView() {
+	return view(PHYSFS_getUserDir());
+}
+
+std::string_view getWriteDirView() {
+	return view(PHYSFS_getWriteDir());
+}
+
+std::string_view getRealDirView(const string& filename) {
+	return view(PHYSFS_getRealDir(filename.c_str()));
+}
+
+std::string_view getMountPointView(const string& dir) {
+	return view(PHYSFS_getMountPoint(dir.c_str()));
+}
+
+std::shared_ptr<ConfigDirs const> getConfigDirs() {
+	std::shared_ptr<ConfigDirs const> dirs = std::atomic_load(&configDirs);
+	if (!dirs) {
+		refreshConfigDirs();
+		dirs = std::atomic_load(&configDirs);
+	}
+	return dirs;
+}
+
+Result<void> tryInit(const char* argv0) {
+	Result<void> status = check(PHYSFS_init(argv0));
+	refreshConfigDirs();
+	return status;
+}
+
+Result<void> tryDeinit() {
+	forgetAllDirectories();
+	Result<void> status = check(PHYSFS_deinit());
+	refreshConfigDirs();
+	return status;
+}
+
+Result<void> trySetWriteDir(const string& newDir) {
+	forgetAllDirectories();
+	Result<void> status = check(PHYSFS_setWriteDir(newDir.c_str()));
+	refreshConfigDirs();
+	return status;
+}
+
+Result<void> tryRemoveFromSearchPath(const string& oldDir) {
+	return check(PHYSFS_removeFromSearchPath(oldDir.c_str()));
+}
+
+Result<void> trySetSaneConfig(const string& orgName, const string& appName,
+		const string& archiveExt, bool includeCdRoms, bool archivesFirst) {
+	forgetAllDirectories();
+	Result<void> status = check(PHYSFS_setSaneConfig(orgName.c_str(), appName.c_str(), archiveExt.c_str(), includeCdRoms, archivesFirst));
+	refreshConfigDirs();
+	return status;
+}
+
+Result<void> tryMkdir(const string& dirName) {
+	return check(PHYSFS_mkdir(dirName.c_str()));
+}
+
+Result<void> tryDeleteFile(const string& filename) {
+	forgetDirectories(filename);
+	return check(PHYSFS_delete(filename.c_str()));
+}
+
+Result<void> tryMount(const string& newDir, const string& mountPoint, bool appendToPath) {
+	return check(PHYSFS_mount(newDir.c_str(), mountPoint.c_str(), appendToPath));
+}
+
+Result<string> tryGetRealDir(const string& filename) {
+	char const * dir = PHYSFS_getRealDir(filename.c_str());
+	if (dir == NULL) {
+		return lastError();
+	}
+	return string(dir);
+}
+
+Result<string> tryGetMountPoint(const string& dir) {
+	char const * mountPoint = PHYSFS_getMountPoint(dir.c_str());
+	if (mountPoint == NULL) {
+		return lastError();
+	}
+	return string(mountPoint);
 }
 
 sint16 Util::swapSLE16(sint16 value) {
@@ -0,0 +1,61 @@
+#include <stdexcept>
+#include <string.h>
+#include "physfs_reader.hpp"
+#include "fbuf.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+peekbuf * checkedBuffer(std::streambuf * stream) {
+	peekbuf * buffer = peekable(stream);
+	if (buffer == NULL) {
+		PHYSFSPP_THROW(std::invalid_argument("stream is not backed by a PhysFS buffer"));
+	}
+	return buffer;
+}
+
+}
+
+LineReader::LineReader(ifstream & stream) : buffer(checkedBuffer(stream.rdbuf())), number(0) {}
+
+LineReader::LineReader(fstream & stream) : buffer(checkedBuffer(stream.rdbuf())), number(0) {}
+
+bool LineReader::next(std::string_view & line) {
+	carry.clear();
+	for (;;) {
+		std::string_view available = buffer->contiguous();
+		if (available.empty()) {
+			if (carry.empty()) {
+				return false;
+			}
+			line = carry;
+			number++;
+			return true;
+		}
+		char const * newline = (char const *) memchr(available.data(), '\n', available.size());
+		if (newline == NULL) {
+			carry.append(available.data(), available.size());
+			buffer->consume(available.size());
+			continue;
+		}
+		// consuming within the buffered region never refills it, so the
+		// view stays good until contiguous() is called again
+		std::size_t length = newline - available.data();
+		buffer->consume(length + 1);
+		if (carry.empty()) {
+			line = available.substr(0, length);
+		} else {
+			carry.append(available.data(), length);
+			line = carry;
+		}
+		number++;
+		return true;
+	}
+}
+
+uint64 LineReader::lineNumber() const {
+	return number;
+}
+
+}
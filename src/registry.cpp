@@ -0,0 +1,188 @@
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "physfs_registry.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+// empty if the file cannot be opened or read in full
+Content readContent(string const & path) {
+	PHYSFS_File * file = tryOpenWithMode(path.c_str(), READ);
+	if (file == NULL) {
+		return Content();
+	}
+	string data;
+	PHYSFS_sint64 length = PHYSFS_fileLength(file);
+	bool complete = true;
+	if (length > 0) {
+		data.resize(length);
+		// a failed (-1) or short read would pass off part of the file as all of it
+		complete = PHYSFS_read(file, &data[0], 1, length) == length;
+	}
+	PHYSFS_close(file);
+	if (!complete) {
+		return Content();
+	}
+	return Content(new string(std::move(data)));
+}
+
+}
+
+Resource::Resource() {}
+
+Resource::Resource(std::shared_ptr<slot> const & loaded) : loaded(loaded) {}
+
+Content Resource::get() const {
+	if (!loaded) {
+		return Content();
+	}
+	return std::atomic_load(&loaded->content);
+}
+
+string const & Resource::getPath() const {
+	static string const none;
+	return loaded ? loaded->path : none;
+}
+
+bool Resource::isLoaded() const {
+	return loaded.get() != NULL;
+}
+
+class Registry::State : public std::enable_shared_from_this<Registry::State> {
+public:
+	typedef std::shared_ptr<Resource::slot> slotPointer;
+
+	std::mutex lock;
+	std::map<string, std::weak_ptr<Resource::slot> > entries;
+	std::map<string, std::shared_future<slotPointer> > loading;
+
+	// the last Resource going away removes the entry, unless the path has
+	// already been loaded again
+	slotPointer makeSlot(string const & path, Content const & content) {
+		std::weak_ptr<State> owner = shared_from_this();
+		Resource::slot * created = new Resource::slot();
+		created->path = path;
+		created->content = content;
+		return slotPointer(created, [owner](Resource::slot * released) {
+			std::shared_ptr<State> state = owner.lock();
+			if (state) {
+				std::lock_guard<std::mutex> guard(state->lock);
+				std::map<string, std::weak_ptr<Resource::slot> >::iterator entry = state->entries.find(released->path);
+				if (entry != state->entries.end() && entry->second.expired()) {
+					state->entries.erase(entry);
+				}
+			}
+			delete released;
+		});
+	}
+
+	// shared pointers taken from entries are declared before the guard in the
+	// callers below, so a last reference is never dropped with lock held
+	slotPointer find(string const & path) {
+		std::map<string, std::weak_ptr<Resource::slot> >::iterator entry = entries.find(path);
+		return entry != entries.end() ? entry->second.lock() : slotPointer();
+	}
+};
+
+Registry::Registry() : state(new State()) {}
+
+Registry::~Registry() {}
+
+Resource Registry::load(string const & path) {
+	string key = normalizePath(path);
+	State::slotPointer found;
+	std::shared_future<State::slotPointer> pending;
+	std::promise<State::slotPointer> promise;
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		found = state->find(key);
+		if (found) {
+			return Resource(found);
+		}
+		std::map<string, std::shared_future<State::slotPointer> >::iterator inFlight = state->loading.find(key);
+		if (inFlight != state->loading.end()) {
+			pending = inFlight->second;
+		} else {
+			state->loading[key] = promise.get_future().share();
+		}
+	}
+	if (pending.valid()) {
+		return Resource(pending.get());
+	}
+
+	Content content = readContent(key);
+	if (!content) {
+		std::invalid_argument error("cannot read file: " + key);
+		std::lock_guard<std::mutex> guard(state->lock);
+		state->loading.erase(key);
+		promise.set_exception(std::make_exception_ptr(error));
+		PHYSFSPP_THROW(error);
+	}
+	found = state->makeSlot(key, content);
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->entries[key] = found;
+	state->loading.erase(key);
+	promise.set_value(found);
+	return Resource(found);
+}
+
+bool Registry::reload(string const & path) {
+	string key = normalizePath(path);
+	State::slotPointer found;
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		found = state->find(key);
+	}
+	if (!found) {
+		return false;
+	}
+	Content content = readContent(key);
+	if (!content) {
+		return false;
+	}
+	std::atomic_store(&found->content, content);
+	return true;
+}
+
+void Registry::onChange(ChangeList const & changes) {
+	for (ChangeList::const_iterator change = changes.begin(); change != changes.end(); ++change) {
+		if (change->type == ChangeEvent::REMOVED) {
+			continue;
+		}
+		if (change->type != ChangeEvent::RESCAN) {
+			reload(change->path);
+			continue;
+		}
+		StringList loaded;
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			string prefix = joinPath(normalizePath(change->path), "");
+			for (std::map<string, std::weak_ptr<Resource::slot> >::const_iterator entry = state->entries.begin(); entry != state->entries.end(); ++entry) {
+				if (entry->first.compare(0, prefix.size(), prefix) == 0) {
+					loaded.push_back(entry->first);
+				}
+			}
+		}
+		for (StringList::const_iterator path = loaded.begin(); path != loaded.end(); ++path) {
+			reload(*path);
+		}
+	}
+}
+
+std::size_t Registry::size() const {
+	std::lock_guard<std::mutex> guard(state->lock);
+	std::size_t live = 0;
+	for (std::map<string, std::weak_ptr<Resource::slot> >::const_iterator entry = state->entries.begin(); entry != state->entries.end(); ++entry) {
+		if (!entry->second.expired()) {
+			live++;
+		}
+	}
+	return live;
+}
+
+}
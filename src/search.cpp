@@ -0,0 +1,276 @@
+#include <atomic>
+#include <ctype.h>
+#include <mutex>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+#include "physfs_search.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+// One pattern. memchr, which libc vectorizes, skips to each occurrence of
+// its first byte and memcmp checks the rest. Matches need the previous
+// pattern length - 1 bytes kept in front of each block.
+class substring {
+private:
+	string const pattern;
+public:
+	explicit substring(string const & pattern) : pattern(pattern) {}
+
+	std::size_t overlap() const {
+		return pattern.size() - 1;
+	}
+
+	template <typename Found>
+	bool scan(uint32 &, char const * text, std::size_t length, uint64 base, Found const & found) const {
+		std::size_t const size = pattern.size();
+		if (length < size) {
+			return true;
+		}
+		char const * const end = text + length - size + 1;
+		for (char const * at = text; (at = (char const *) memchr(at, pattern[0], end - at)) != NULL; ++at) {
+			if (memcmp(at + 1, pattern.data() + 1, size - 1) == 0 && !found(0, base + (at - text))) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// Several patterns as a DFA with a full row of transitions per state, so
+// each byte costs one table lookup. The state carries over from one block
+// to the next, so nothing needs to be kept.
+class automaton {
+private:
+	std::vector<uint32> transitions;
+	// patterns ending at state s are matches[firstMatch[s]..firstMatch[s + 1])
+	std::vector<uint32> firstMatch;
+	std::vector<uint32> matches;
+	std::vector<std::size_t> lengths;
+	unsigned char folded[256];
+public:
+	automaton(StringList const & patterns, bool ignoreCase) {
+		for (unsigned c = 0; c < 256; c++) {
+			folded[c] = ignoreCase ? tolower(c) : c;
+		}
+		// trie, with 0 as "no edge" since nothing leads back to the root
+		transitions.assign(256, 0);
+		std::vector<std::vector<uint32> > ending(1);
+		for (std::size_t i = 0; i < patterns.size(); i++) {
+			uint32 state = 0;
+			for (std::size_t j = 0; j < patterns[i].size(); j++) {
+				unsigned char c = folded[(unsigned char) patterns[i][j]];
+				if (transitions[state * 256 + c] == 0) {
+					transitions[state * 256 + c] = ending.size();
+					transitions.resize(transitions.size() + 256, 0);
+					ending.push_back(std::vector<uint32>());
+				}
+				state = transitions[state * 256 + c];
+			}
+			ending[state].push_back(i);
+			lengths.push_back(patterns[i].size());
+		}
+		// breadth first, filling missing edges from each state's failure
+		// state, which is always shallower and so already complete
+		std::vector<uint32> failure(ending.size(), 0);
+		std::vector<uint32> queue;
+		for (unsigned c = 0; c < 256; c++) {
+			if (transitions[c] != 0) {
+				queue.push_back(transitions[c]);
+			}
+		}
+		for (std::size_t i = 0; i < queue.size(); i++) {
+			uint32 state = queue[i];
+			ending[state].insert(ending[state].end(), ending[failure[state]].begin(), ending[failure[state]].end());
+			for (unsigned c = 0; c < 256; c++) {
+				uint32 & next = transitions[state * 256 + c];
+				if (next != 0) {
+					failure[next] = transitions[failure[state] * 256 + c];
+					queue.push_back(next);
+				} else {
+					next = transitions[failure[state] * 256 + c];
+				}
+			}
+		}
+		for (std::size_t state = 0; state < ending.size(); state++) {
+			firstMatch.push_back(matches.size());
+			matches.insert(matches.end(), ending[state].begin(), ending[state].end());
+		}
+		firstMatch.push_back(matches.size());
+	}
+
+	std::size_t overlap() const {
+		return 0;
+	}
+
+	template <typename Found>
+	bool scan(uint32 & current, char const * text, std::size_t length, uint64 base, Found const & found) const {
+		uint32 state = current;
+		for (std::size_t i = 0; i < length; i++) {
+			state = transitions[state * 256 + folded[(unsigned char) text[i]]];
+			for (uint32 j = firstMatch[state]; j < firstMatch[state + 1]; j++) {
+				if (!found(matches[j], base + i + 1 - lengths[matches[j]])) {
+					current = state;
+					return false;
+				}
+			}
+		}
+		current = state;
+		return true;
+	}
+};
+
+class reporter {
+private:
+	MatchCallback const & onMatch;
+	bool const firstOnly;
+	std::mutex lock;
+	std::atomic<bool> stop;
+	uint64 count;
+public:
+	reporter(MatchCallback const & onMatch, bool firstOnly)
+		: onMatch(onMatch), firstOnly(firstOnly), stop(false), count(0) {}
+
+	bool stopped() const {
+		return stop;
+	}
+
+	uint64 reported() const {
+		return count;
+	}
+
+	// false once the rest of the file should be skipped
+	bool found(string const & path, uint64 offset, std::size_t pattern) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (stop) {
+			return false;
+		}
+		count++;
+		SearchMatch match = {path, offset, pattern};
+		if (!onMatch(match)) {
+			stop = true;
+		}
+		return !stop && !firstOnly;
+	}
+};
+
+template <typename Matcher>
+void searchFile(string const & path, Matcher const & matcher, std::size_t blockSize, reporter & report) {
+	PHYSFS_File * file = tryOpenWithMode(path.c_str(), READ);
+	if (file == NULL) {
+		return;
+	}
+	fileHandle handle(file);
+	PHYSFS_sint64 length = PHYSFS_fileLength(file);
+	if (length >= 0 && (uint64) length < blockSize) {
+		blockSize = length > 0 ? length : 1;
+	}
+	std::size_t const overlap = matcher.overlap();
+	std::vector<char> buffer(overlap + blockSize);
+	std::size_t kept = 0;
+	// file offset of buffer[0]
+	uint64 base = 0;
+	uint32 state = 0;
+	auto found = [&](std::size_t pattern, uint64 offset) {
+		return report.found(path, offset, pattern);
+	};
+	while (!report.stopped()) {
+		PHYSFS_sint64 bytesRead = PHYSFS_read(file, buffer.data() + kept, 1, blockSize);
+		if (bytesRead < 0) {
+			PHYSFSPP_THROW(std::runtime_error("could not read " + path));
+		}
+		if (bytesRead == 0) {
+			return;
+		}
+		std::size_t filled = kept + bytesRead;
+		if (!matcher.scan(state, buffer.data(), filled, base, found)) {
+			return;
+		}
+		kept = filled < overlap ? filled : overlap;
+		memmove(buffer.data(), buffer.data() + filled - kept, kept);
+		base += filled - kept;
+	}
+}
+
+template <typename Matcher>
+uint64 searchTree(string const & root, Matcher const & matcher, MatchCallback const & onMatch, SearchOptions const & options) {
+	StringList files = listTree(root);
+	reporter report(onMatch, options.getFirstMatchOnly());
+	parallelFor(files.size(), options.getThreads(), [&](std::size_t i) {
+		if (!report.stopped()) {
+			searchFile(files[i], matcher, options.getBlockSize(), report);
+		}
+	});
+	return report.reported();
+}
+
+}
+
+SearchOptions::SearchOptions() : threadCount(0), blockBytes(1024 * 1024), ignoring(false), firstOnly(false) {}
+
+SearchOptions & SearchOptions::threads(unsigned count) {
+	threadCount = count;
+	return *this;
+}
+
+SearchOptions & SearchOptions::blockSize(std::size_t bytes) {
+	if (bytes == 0) {
+		PHYSFSPP_THROW(std::invalid_argument("block size must not be 0"));
+	}
+	blockBytes = bytes;
+	return *this;
+}
+
+SearchOptions & SearchOptions::ignoreCase(bool ignore) {
+	ignoring = ignore;
+	return *this;
+}
+
+SearchOptions & SearchOptions::firstMatchOnly(bool first) {
+	firstOnly = first;
+	return *this;
+}
+
+unsigned SearchOptions::getThreads() const {
+	return threadCount;
+}
+
+std::size_t SearchOptions::getBlockSize() const {
+	return blockBytes;
+}
+
+bool SearchOptions::getIgnoreCase() const {
+	return ignoring;
+}
+
+bool SearchOptions::getFirstMatchOnly() const {
+	return firstOnly;
+}
+
+uint64 search(string const & root, string const & pattern, MatchCallback const & onMatch, SearchOptions const & options) {
+	if (pattern.empty()) {
+		PHYSFSPP_THROW(std::invalid_argument("empty search pattern"));
+	}
+	if (options.getIgnoreCase()) {
+		return searchTree(root, automaton(StringList(1, pattern), true), onMatch, options);
+	}
+	return searchTree(root, substring(pattern), onMatch, options);
+}
+
+uint64 search(string const & root, StringList const & patterns, MatchCallback const & onMatch, SearchOptions const & options) {
+	if (patterns.empty()) {
+		PHYSFSPP_THROW(std::invalid_argument("no search patterns"));
+	}
+	for (std::size_t i = 0; i < patterns.size(); i++) {
+		if (patterns[i].empty()) {
+			PHYSFSPP_THROW(std::invalid_argument("empty search pattern"));
+		}
+	}
+	return searchTree(root, automaton(patterns, options.getIgnoreCase()), onMatch, options);
+}
+
+}
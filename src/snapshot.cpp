@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <map>
+#include "physfs_watch.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+Snapshot::Snapshot() {}
+
+std::size_t Snapshot::size() const {
+	return records.size();
+}
+
+string Snapshot::path(record const & r) const {
+	return paths.substr(r.pathOffset, r.pathLength);
+}
+
+Snapshot::Entry Snapshot::entry(std::size_t index) const {
+	record const & r = records[index];
+	Entry e = { path(r), r.size, r.modTime, mounts[r.mount] };
+	return e;
+}
+
+string const & Snapshot::getRoot() const {
+	return root;
+}
+
+Snapshot snapshot(string const & root, unsigned threads) {
+	StringList files = listTree(root);
+	std::sort(files.begin(), files.end());
+
+	std::vector<sint64> sizes(files.size());
+	std::vector<sint64> modTimes(files.size());
+	StringList realDirs(files.size());
+	parallelFor(files.size(), threads, [&](std::size_t i) {
+		char const * filename = files[i].c_str();
+		PHYSFS_File * file = PHYSFS_openRead(filename);
+		sizes[i] = -1;
+		if (file != NULL) {
+			sizes[i] = PHYSFS_fileLength(file);
+			PHYSFS_close(file);
+		}
+		modTimes[i] = PHYSFS_getLastModTime(filename);
+		char const * realDir = PHYSFS_getRealDir(filename);
+		if (realDir != NULL) {
+			realDirs[i] = realDir;
+		}
+	});
+
+	Snapshot result;
+	result.root = normalizePath(root);
+	result.records.reserve(files.size());
+	std::map<string, uint32> mountIndex;
+	for (std::size_t i = 0; i < files.size(); i++) {
+		std::map<string, uint32>::iterator mount = mountIndex.find(realDirs[i]);
+		if (mount == mountIndex.end()) {
+			mount = mountIndex.insert(std::make_pair(realDirs[i], (uint32) result.mounts.size())).first;
+			result.mounts.push_back(realDirs[i]);
+		}
+		Snapshot::record r = { sizes[i], modTimes[i], (uint32) result.paths.size(), (uint32) files[i].size(), mount->second };
+		result.records.push_back(r);
+		result.paths += files[i];
+	}
+	return result;
+}
+
+ChangeList diff(Snapshot const & before, Snapshot const & after) {
+	ChangeList changes;
+	std::size_t i = 0;
+	std::size_t j = 0;
+	while (i < before.records.size() || j < after.records.size()) {
+		int order;
+		if (i == before.records.size()) {
+			order = 1;
+		} else if (j == after.records.size()) {
+			order = -1;
+		} else {
+			Snapshot::record const & a = before.records[i];
+			Snapshot::record const & b = after.records[j];
+			order = before.paths.compare(a.pathOffset, a.pathLength, after.paths, b.pathOffset, b.pathLength);
+		}
+		if (order < 0) {
+			ChangeEvent change = { before.path(before.records[i++]), ChangeEvent::REMOVED };
+			changes.push_back(change);
+		} else if (order > 0) {
+			ChangeEvent change = { after.path(after.records[j++]), ChangeEvent::ADDED };
+			changes.push_back(change);
+		} else {
+			Snapshot::record const & a = before.records[i++];
+			Snapshot::record const & b = after.records[j++];
+			if (a.size != b.size || a.modTime != b.modTime || before.mounts[a.mount] != after.mounts[b.mount]) {
+				ChangeEvent change = { after.path(b), ChangeEvent::MODIFIED };
+				changes.push_back(change);
+			}
+		}
+	}
+	return changes;
+}
+
+}
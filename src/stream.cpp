@@ -0,0 +1,103 @@
+#include <atomic>
+#include <map>
+#include <new>
+#include <vector>
+#include "physfs_stream.hpp"
+#include "physfs_budget.hpp"
+
+namespace PhysFS {
+
+namespace {
+
+// bytes held by every thread's pool
+std::atomic<std::size_t> pooledBytes(0);
+// bumped by a trim; each pool empties itself when it next sees a new value
+std::atomic<uint64> trims(0);
+
+// freed blocks kept per size, released when the thread exits
+class blockPool {
+private:
+	static std::size_t const keptPerSize = 8;
+
+	std::map<std::size_t, std::vector<void *> > free;
+	uint64 trimmed;
+
+	std::size_t release() {
+		std::size_t released = 0;
+		for (std::map<std::size_t, std::vector<void *> >::iterator i = free.begin(); i != free.end(); ++i) {
+			for (std::size_t j = 0; j < i->second.size(); ++j) {
+				::operator delete(i->second[j]);
+			}
+			released += i->first * i->second.size();
+		}
+		free.clear();
+		pooledBytes -= released;
+		return released;
+	}
+
+	void checkTrimmed() {
+		if (trimmed != trims) {
+			trimmed = trims;
+			release();
+		}
+	}
+public:
+	blockPool() : trimmed(trims) {}
+
+	~blockPool() {
+		release();
+	}
+
+	// empties this pool now and every other one when next used, returning
+	// what this one held
+	std::size_t trim() {
+		trimmed = ++trims;
+		return release();
+	}
+
+	void * take(std::size_t bytes) {
+		checkTrimmed();
+		std::vector<void *> & blocks = free[bytes];
+		if (blocks.empty()) {
+			return ::operator new(bytes);
+		}
+		void * block = blocks.back();
+		blocks.pop_back();
+		pooledBytes -= bytes;
+		return block;
+	}
+
+	void give(void * block, std::size_t bytes) {
+		checkTrimmed();
+		std::vector<void *> & blocks = free[bytes];
+		if (blocks.size() < keptPerSize) {
+			blocks.push_back(block);
+			pooledBytes += bytes;
+		} else {
+			::operator delete(block);
+		}
+	}
+};
+
+thread_local blockPool pool;
+
+// Other threads' blocks go when each next uses its pool, so only the
+// trimming thread's count as released and usage lags until then. Cheapest
+// to give back: they are only buffers waiting for reuse.
+uint64 const budgetId = MemoryBudget::global().add(1, [] {
+	return pooledBytes.load();
+}, [](std::size_t) {
+	return pool.trim();
+});
+
+}
+
+void * PooledAllocation::allocate(std::size_t bytes) {
+	return pool.take(bytes);
+}
+
+void PooledAllocation::deallocate(void * block, std::size_t bytes) {
+	pool.give(block, bytes);
+}
+
+}
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+#include "physfs_tree.hpp"
+#include "physfs_budget.hpp"
+#include "fbuf.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+string joinPath(string const & directory, string const & name) {
+	if (directory.empty() || directory == "/") {
+		return name;
+	}
+	if (directory[directory.size() - 1] == '/') {
+		return directory + name;
+	}
+	return directory + "/" + name;
+}
+
+StringList listTree(string const & root, StringList * directories) {
+	StringList files;
+	StringList pending(1, root);
+	while (!pending.empty()) {
+		string directory = pending.back();
+		pending.pop_back();
+		StringList entries = enumerateFiles(directory);
+		for (StringList::const_iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+			string path = joinPath(directory, *entry);
+			if (isDirectory(path)) {
+				if (directories != NULL) {
+					directories->push_back(path);
+				}
+				pending.push_back(path);
+			} else {
+				files.push_back(path);
+			}
+		}
+	}
+	return files;
+}
+
+namespace {
+
+string trimSlashes(string path) {
+	std::size_t begin = path.find_first_not_of('/');
+	if (begin == string::npos) {
+		return "";
+	}
+	return path.substr(begin, path.find_last_not_of('/') - begin + 1);
+}
+
+string toNative(string const & directory, string relative) {
+	std::string_view separator = getDirSeparatorView();
+	if (separator != "/") {
+		for (std::size_t slash = relative.find('/'); slash != string::npos; slash = relative.find('/', slash)) {
+			relative.replace(slash, 1, separator);
+			slash += separator.size();
+		}
+	}
+	if (relative.empty()) {
+		return directory;
+	}
+	if (directory.size() >= separator.size()
+			&& directory.compare(directory.size() - separator.size(), separator.size(), separator) == 0) {
+		return directory + relative;
+	}
+	string native = directory;
+	native.append(separator);
+	return native + relative;
+}
+
+}
+
+string nativePath(string const & filename) {
+	char const * realDir = PHYSFS_getRealDir(filename.c_str());
+	struct stat info;
+	if (realDir == NULL || stat(realDir, &info) != 0 || !S_ISDIR(info.st_mode)) {
+		return "";
+	}
+	char const * mountPoint = PHYSFS_getMountPoint(realDir);
+	return nativePathUnder(realDir, mountPoint != NULL ? mountPoint : "", filename);
+}
+
+string nativePathUnder(string const & dir, string const & mountPoint, string const & filename) {
+	string relative = trimSlashes(filename);
+	string mounted = trimSlashes(mountPoint);
+	if (!mounted.empty()) {
+		if (relative.compare(0, mounted.size(), mounted) != 0
+				|| (relative.size() > mounted.size() && relative[mounted.size()] != '/')) {
+			return "";
+		}
+		relative = trimSlashes(relative.substr(mounted.size()));
+	}
+	return toNative(dir, relative);
+}
+
+string writeDirPath(string const & filename) {
+	char const * writeDir = PHYSFS_getWriteDir();
+	if (writeDir == NULL) {
+		return "";
+	}
+	return toNative(writeDir, trimSlashes(filename));
+}
+
+string normalizePath(string const & path) {
+	string normalized;
+	for (std::size_t i = 0; i < path.size(); i++) {
+		if (path[i] != '/' || (!normalized.empty() && normalized[normalized.size() - 1] != '/')) {
+			normalized += path[i];
+		}
+	}
+	return trimSlashes(normalized);
+}
+
+unsigned defaultThreads() {
+	unsigned threads = std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+void parallelFor(std::size_t count, unsigned threads, std::function<void(std::size_t)> const & task) {
+	if (threads == 0) {
+		threads = defaultThreads();
+	}
+	if (threads > count) {
+		threads = count;
+	}
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex errorLock;
+	auto work = [&]() {
+		for (std::size_t i = next++; i < count; i = next++) {
+#ifdef PHYSFSPP_NO_EXCEPTIONS
+			task(i);
+#else
+			try {
+				task(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorLock);
+				if (!error) {
+					error = std::current_exception();
+				}
+				next = count;
+			}
+#endif
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threads; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for (std::size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+namespace {
+
+std::size_t const copyBlockSize = 1024 * 1024;
+std::size_t const copyAlignment = 4096;
+
+typedef std::function<void(uint64 copied, uint64 length)> copyReporter;
+
+#ifdef __linux__
+class fdHandle {
+private:
+	fdHandle(const fdHandle & other);
+	fdHandle& operator=(const fdHandle& other);
+public:
+	fdHandle(int fd) : fd(fd) {}
+
+	~fdHandle() {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	int const fd;
+};
+
+// lets the kernel move the bytes; returns false if nothing could be done
+// this way, in which case the caller falls back to reading through PhysFS
+bool kernelCopy(string const & from, string const & to, copyReporter const & report, uint64 & copied) {
+	fdHandle in(open(from.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat info;
+	if (in.fd < 0 || fstat(in.fd, &info) != 0) {
+		return false;
+	}
+	fdHandle out(open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+	if (out.fd < 0) {
+		return false;
+	}
+	uint64 length = info.st_size;
+	bool useSendfile = false;
+	copied = 0;
+	while (copied < length) {
+		std::size_t want = length - copied < copyBlockSize * 16 ? length - copied : copyBlockSize * 16;
+		ssize_t moved;
+		if (!useSendfile) {
+			moved = copy_file_range(in.fd, NULL, out.fd, NULL, want, 0);
+			if (moved < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+				useSendfile = true;
+				continue;
+			}
+		} else {
+			moved = sendfile(out.fd, in.fd, NULL, want);
+		}
+		if (moved <= 0) {
+			return false;
+		}
+		copied += moved;
+		report(copied, length);
+	}
+	return true;
+}
+#endif
+
+uint64 bufferedCopy(string const & source, string const & destination, copyReporter const & report) {
+	fileHandle in(openWithMode(source.c_str(), READ));
+	fileHandle out(openWithMode(destination.c_str(), WRITE));
+	PHYSFS_sint64 length = PHYSFS_fileLength(in.file);
+	// small files, the common case in a tree, don't need a whole block
+	std::size_t blockSize = copyBlockSize;
+	if (length >= 0 && (uint64) length < copyBlockSize) {
+		blockSize = length > 0 ? (std::size_t) length : 1;
+	}
+	std::unique_ptr<char[]> storage(new char[blockSize + copyAlignment]);
+	void * aligned = storage.get();
+	std::size_t space = blockSize + copyAlignment;
+	std::align(copyAlignment, blockSize, aligned, space);
+	char * buffer = (char *) aligned;
+
+	uint64 copied = 0;
+	PHYSFS_sint64 bytesRead;
+	while ((bytesRead = PHYSFS_read(in.file, buffer, 1, blockSize)) > 0) {
+		if (PHYSFS_write(out.file, buffer, bytesRead, 1) < 1) {
+			PHYSFSPP_THROW(std::runtime_error("write failed: " + destination));
+		}
+		copied += bytesRead;
+		report(copied, length < 0 ? copied : length);
+	}
+	if (bytesRead < 0) {
+		PHYSFSPP_THROW(std::runtime_error("read failed: " + source));
+	}
+	return copied;
+}
+
+uint64 copyFile(string const & source, string const & destination, copyReporter const & report) {
+#ifdef __linux__
+	string from = nativePath(source);
+	string to = writeDirPath(destination);
+	uint64 copied;
+	if (!from.empty() && !to.empty() && kernelCopy(from, to, report, copied)) {
+		return copied;
+	}
+#endif
+	return bufferedCopy(source, destination, report);
+}
+
+}
+
+uint64 copy(string const & source, string const & destination, ProgressCallback const & progress) {
+	CopyProgress state = { source, 0, 0, 0, 1 };
+	uint64 copied = copyFile(source, destination, [&](uint64 bytes, uint64 length) {
+		state.bytesCopied = bytes;
+		state.fileLength = length;
+		if (progress) {
+			progress(state);
+		}
+	});
+	state.filesDone = 1;
+	if (progress) {
+		progress(state);
+	}
+	return copied;
+}
+
+uint64 extractTree(string const & sourceDir, string const & destinationDir, ProgressCallback const & progress, unsigned threads) {
+	StringList directories;
+	StringList files = listTree(sourceDir, &directories);
+	std::size_t prefix = joinPath(sourceDir, "").size();
+
+	mkdirs(destinationDir);
+	for (StringList::const_iterator directory = directories.begin(); directory != directories.end(); ++directory) {
+		mkdirs(joinPath(destinationDir, directory->substr(prefix)));
+	}
+
+	std::mutex progressLock;
+	std::atomic<uint64> total(0);
+	uint64 filesDone = 0;
+	parallelFor(files.size(), threads, [&](std::size_t i) {
+		CopyProgress state = { files[i], 0, 0, 0, files.size() };
+		uint64 copied = copyFile(files[i], joinPath(destinationDir, files[i].substr(prefix)), [&](uint64 bytes, uint64 length) {
+			if (progress) {
+				std::lock_guard<std::mutex> lock(progressLock);
+				state.bytesCopied = bytes;
+				state.fileLength = length;
+				state.filesDone = filesDone;
+				progress(state);
+			}
+		});
+		total += copied;
+		std::lock_guard<std::mutex> lock(progressLock);
+		state.filesDone = ++filesDone;
+		if (progress) {
+			progress(state);
+		}
+	});
+	return total;
+}
+
+namespace {
+
+std::mutex knownDirectoriesLock;
+std::set<string> knownDirectories;
+
+// rough heap use of a set of paths
+std::size_t footprint(std::set<string> const & paths) {
+	std::size_t bytes = 0;
+	for (std::set<string>::const_iterator i = paths.begin(); i != paths.end(); ++i) {
+		bytes += sizeof(string) + i->capacity() + 4 * sizeof(void *);
+	}
+	return bytes;
+}
+
+// Cheap to rebuild: forgetting costs a PHYSFS_mkdir per directory on the
+// next mkdirs below it. It is all or nothing, so any trim empties it.
+uint64 const budgetId = MemoryBudget::global().add(10, [] {
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	return footprint(knownDirectories);
+}, [](std::size_t) {
+	std::set<string> dropped;
+	{
+		std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+		dropped.swap(knownDirectories);
+	}
+	return footprint(dropped);
+});
+
+bool isKnownDirectory(string const & path) {
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	return knownDirectories.count(path) > 0;
+}
+
+// length of the longest parent of path known to exist, 0 if there is none
+std::size_t knownParent(string const & path) {
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	for (std::size_t slash = path.rfind('/'); slash != string::npos && slash > 0; slash = path.rfind('/', slash - 1)) {
+		if (knownDirectories.count(path.substr(0, slash)) > 0) {
+			return slash;
+		}
+	}
+	return 0;
+}
+
+// PHYSFS_mkdir checks every component from the top on each call, so below a
+// directory already known to exist the rest are created in the write dir
+// directly
+bool mkdirsBelow(string const & path, std::size_t known) {
+	namespace fs = std::filesystem;
+	for (std::size_t slash = path.find('/', known + 1); ; slash = path.find('/', slash + 1)) {
+		string native = writeDirPath(path.substr(0, slash));
+		if (native.empty()) {
+			return false;
+		}
+		std::error_code error;
+		fs::create_directory(native, error);
+		if (error) {
+			return false;
+		}
+		if (slash == string::npos) {
+			return true;
+		}
+	}
+}
+
+std::size_t depth(string const & path) {
+	return std::count(path.begin(), path.end(), '/');
+}
+
+bool deeperFirst(string const & a, string const & b) {
+	return depth(a) > depth(b);
+}
+
+}
+
+void forgetDirectories(string const & path) {
+	string normalized = normalizePath(path);
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	if (normalized.empty()) {
+		knownDirectories.clear();
+		return;
+	}
+	knownDirectories.erase(normalized);
+	// everything in ["a/", "a0") starts with "a/", as '0' follows '/'
+	knownDirectories.erase(knownDirectories.lower_bound(normalized + "/"), knownDirectories.lower_bound(normalized + "0"));
+}
+
+void forgetAllDirectories() {
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	knownDirectories.clear();
+}
+
+bool mkdirs(string const & path) {
+	string normalized = normalizePath(path);
+	if (normalized.empty() || isKnownDirectory(normalized)) {
+		return true;
+	}
+	std::size_t known = knownParent(normalized);
+	if (known > 0 ? !mkdirsBelow(normalized, known) : !PHYSFS_mkdir(normalized.c_str())) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(knownDirectoriesLock);
+	for (std::size_t slash = normalized.find('/'); slash != string::npos; slash = normalized.find('/', slash + 1)) {
+		knownDirectories.insert(normalized.substr(0, slash));
+	}
+	knownDirectories.insert(normalized);
+	return true;
+}
+
+uint64 removeTree(string const & path, unsigned threads) {
+	string root = normalizePath(path);
+	string native = writeDirPath(root);
+	if (native.empty()) {
+		PHYSFSPP_THROW(std::runtime_error("no write dir to remove " + root + " from"));
+	}
+	// walked natively, as the write dir need not be on the search path;
+	// symbolic links are removed, never followed
+	namespace fs = std::filesystem;
+	std::error_code error;
+	fs::file_status status = fs::symlink_status(native, error);
+	if (status.type() == fs::file_type::none) {
+		PHYSFSPP_THROW(std::runtime_error("cannot stat " + root + ": " + error.message()));
+	}
+	if (!fs::exists(status)) {
+		return 0;
+	}
+	StringList directories;
+	StringList files;
+	if (fs::is_directory(status)) {
+		// a walk that stops early would leave part of the tree behind
+		fs::recursive_directory_iterator entry(native, error), end;
+		for (; !error && entry != end; entry.increment(error)) {
+			string relative = joinPath(root, entry->path().lexically_relative(native).generic_string());
+			std::error_code ignored;
+			if (entry->is_directory(ignored) && !entry->is_symlink(ignored)) {
+				directories.push_back(relative);
+			} else {
+				files.push_back(relative);
+			}
+		}
+		if (error) {
+			PHYSFSPP_THROW(std::runtime_error("cannot list " + root + ": " + error.message()));
+		}
+	} else {
+		files.push_back(root);
+	}
+	forgetDirectories(root);
+
+	std::atomic<uint64> removed(0);
+	parallelFor(files.size(), threads, [&](std::size_t i) {
+		if (PHYSFS_delete(files[i].c_str())) {
+			removed++;
+		}
+	});
+
+	// a directory can only go once everything below it has, so delete one
+	// depth level at a time
+	std::stable_sort(directories.begin(), directories.end(), deeperFirst);
+	std::size_t begin = 0;
+	while (begin < directories.size()) {
+		std::size_t end = begin;
+		while (end < directories.size() && depth(directories[end]) == depth(directories[begin])) {
+			end++;
+		}
+		parallelFor(end - begin, threads, [&](std::size_t i) {
+			if (PHYSFS_delete(directories[begin + i].c_str())) {
+				removed++;
+			}
+		});
+		begin = end;
+	}
+	if (!root.empty() && fs::is_directory(status) && PHYSFS_delete(root.c_str())) {
+		removed++;
+	}
+	return removed;
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef _INCLUDE_PHYSFS_TREE_HPP_
+#define _INCLUDE_PHYSFS_TREE_HPP_
+
+#include <functional>
+#include "physfs.hpp"
+
+namespace PhysFS {
+
+// "a" + "b" -> "a/b", treating "" and "/" as the root
+string joinPath(string const & directory, string const & name);
+
+// "/a//b/" -> "a/b"
+string normalizePath(string const & path);
+
+// every file below root, depth first, with directories listed separately
+// (parents before children) when directories is non-NULL
+StringList listTree(string const & root, StringList * directories = NULL);
+
+// OS path of a file on the search path when it comes from a native directory,
+// or "" when it comes from an archive or does not exist
+string nativePath(string const & filename);
+
+// OS path of filename in the native directory dir mounted at mountPoint,
+// or "" when filename is not below mountPoint
+string nativePathUnder(string const & dir, string const & mountPoint, string const & filename);
+
+// OS path of filename inside the write dir, or "" when there is none
+string writeDirPath(string const & filename);
+
+// drop what mkdirs knows about path and everything below it
+void forgetDirectories(string const & path);
+
+void forgetAllDirectories();
+
+unsigned defaultThreads();
+
+// calls task(i) for every i in [0, count) from up to threads workers, handing
+// out indices one at a time; the first exception thrown is rethrown here
+void parallelFor(std::size_t count, unsigned threads, std::function<void(std::size_t)> const & task);
+
+}
+
+#endif /* _INCLUDE_PHYSFS_TREE_HPP_ */
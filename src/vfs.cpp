@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "physfs_vfs.hpp"
+#include "tree.hpp"
+
+namespace PhysFS {
+
+class Vfs::Snapshot {
+public:
+	struct mount {
+		string dir;
+		string mountPoint;
+		bool native;
+	};
+
+	std::vector<mount> mounts;
+	// path -> index into mounts of the entry that provides it
+	std::unordered_map<string, std::size_t> files;
+	// directory -> sorted names of its children
+	std::unordered_map<string, StringList> directories;
+};
+
+namespace {
+
+bool isNativeDirectory(string const & path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+void addChild(std::unordered_map<string, StringList> & directories, string const & path) {
+	std::size_t slash = path.rfind('/');
+	string parent = slash == string::npos ? "" : path.substr(0, slash);
+	directories[parent].push_back(path.substr(slash == string::npos ? 0 : slash + 1));
+}
+
+}
+
+Vfs::Vfs() : snapshot(new Snapshot()) {}
+
+Vfs::~Vfs() {}
+
+std::shared_ptr<Vfs::Snapshot const> Vfs::current() const {
+	return std::atomic_load(&snapshot);
+}
+
+// callers hold writer
+void Vfs::rebuild() {
+	std::shared_ptr<Snapshot> next(new Snapshot());
+	StringList searchPath = getSearchPath();
+	std::unordered_map<string, std::size_t> mountIndex;
+	for (StringList::const_iterator dir = searchPath.begin(); dir != searchPath.end(); ++dir) {
+		char const * mountPoint = PHYSFS_getMountPoint(dir->c_str());
+		Snapshot::mount entry = { *dir, mountPoint != NULL ? mountPoint : "", isNativeDirectory(*dir) };
+		mountIndex[*dir] = next->mounts.size();
+		next->mounts.push_back(entry);
+	}
+
+	StringList directories;
+	StringList files = listTree("", &directories);
+	next->directories[""];
+	for (StringList::const_iterator directory = directories.begin(); directory != directories.end(); ++directory) {
+		next->directories[*directory];
+		addChild(next->directories, *directory);
+	}
+	for (StringList::const_iterator file = files.begin(); file != files.end(); ++file) {
+		char const * realDir = PHYSFS_getRealDir(file->c_str());
+		std::unordered_map<string, std::size_t>::const_iterator found = realDir != NULL ? mountIndex.find(realDir) : mountIndex.end();
+		if (found == mountIndex.end()) {
+			continue;
+		}
+		next->files[*file] = found->second;
+		addChild(next->directories, *file);
+	}
+	for (std::unordered_map<string, StringList>::iterator directory = next->directories.begin(); directory != next->directories.end(); ++directory) {
+		std::sort(directory->second.begin(), directory->second.end());
+	}
+	std::atomic_store(&snapshot, std::shared_ptr<Snapshot const>(next));
+}
+
+Result<void> Vfs::mount(string const & newDir, string const & mountPoint, bool appendToPath) {
+	std::lock_guard<std::mutex> guard(writer);
+	Result<void> status = tryMount(newDir, mountPoint, appendToPath);
+	if (status) {
+		rebuild();
+	}
+	return status;
+}
+
+Result<void> Vfs::unmount(string const & oldDir) {
+	std::lock_guard<std::mutex> guard(writer);
+	Result<void> status = tryRemoveFromSearchPath(oldDir);
+	if (status) {
+		rebuild();
+	}
+	return status;
+}
+
+void Vfs::refresh() {
+	std::lock_guard<std::mutex> guard(writer);
+	rebuild();
+}
+
+bool Vfs::exists(string const & filename) const {
+	std::shared_ptr<Snapshot const> index = current();
+	string path = normalizePath(filename);
+	return index->files.count(path) != 0 || index->directories.count(path) != 0;
+}
+
+bool Vfs::isDirectory(string const & filename) const {
+	return current()->directories.count(normalizePath(filename)) != 0;
+}
+
+string Vfs::getRealDir(string const & filename) const {
+	std::shared_ptr<Snapshot const> index = current();
+	std::unordered_map<string, std::size_t>::const_iterator found = index->files.find(normalizePath(filename));
+	return found != index->files.end() ? index->mounts[found->second].dir : "";
+}
+
+StringList Vfs::enumerateFiles(string const & directory) const {
+	std::shared_ptr<Snapshot const> index = current();
+	std::unordered_map<string, StringList>::const_iterator found = index->directories.find(normalizePath(directory));
+	return found != index->directories.end() ? found->second : StringList();
+}
+
+std::size_t Vfs::size() const {
+	return current()->files.size();
+}
+
+std::unique_ptr<std::istream> Vfs::openRead(string const & filename) const {
+	std::shared_ptr<Snapshot const> index = current();
+	string path = normalizePath(filename);
+	std::unordered_map<string, std::size_t>::const_iterator found = index->files.find(path);
+	if (found == index->files.end()) {
+		PHYSFSPP_THROW(std::invalid_argument("file not found: " + filename));
+	}
+	Snapshot::mount const & provider = index->mounts[found->second];
+	if (provider.native) {
+		std::unique_ptr<std::ifstream> native(new std::ifstream(nativePathUnder(provider.dir, provider.mountPoint, path).c_str(), std::ios_base::binary));
+		if (native->is_open()) {
+			return std::unique_ptr<std::istream>(native.release());
+		}
+	}
+	return std::unique_ptr<std::istream>(new ifstream(path));
+}
+
+}
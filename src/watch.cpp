@@ -0,0 +1,331 @@
+#include <stdexcept>
+#include "physfs_watch.hpp"
+#include "tree.hpp"
+
+#ifdef __linux__
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PhysFS {
+
+namespace {
+
+typedef std::chrono::steady_clock watchClock;
+
+uint32 const watchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+	| IN_MOVED_FROM | IN_MOVED_TO | IN_DONT_FOLLOW | IN_ONLYDIR;
+
+// a burst that never goes quiet is still delivered after this many periods
+int const maxDebouncePeriods = 10;
+
+bool isNativeDirectory(string const & path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool isUnder(string const & path, string const & parent) {
+	return parent.empty() || path == parent
+		|| (path.size() > parent.size() && path.compare(0, parent.size(), parent) == 0 && path[parent.size()] == '/');
+}
+
+// folds a new event for a path into the one already pending for it
+bool merge(ChangeEvent::kind & pending, ChangeEvent::kind next) {
+	if (pending == ChangeEvent::ADDED && next == ChangeEvent::REMOVED) {
+		return false;
+	}
+	if (pending == ChangeEvent::REMOVED && next == ChangeEvent::ADDED) {
+		pending = ChangeEvent::MODIFIED;
+	} else if (pending != ChangeEvent::ADDED || next != ChangeEvent::MODIFIED) {
+		pending = next;
+	}
+	return true;
+}
+
+}
+
+class Watcher::Implementation {
+private:
+	struct directory {
+		string native;
+		string virtualPath;
+	};
+
+	ChangeCallback const callback;
+	watchClock::duration const debounce;
+	int const fd;
+	int const wake;
+	std::mutex lock;
+	std::map<int, directory> directories;
+	std::map<string, ChangeEvent::kind> pending;
+	// write-dir-relative directories gone since the last delivery, for mkdirs
+	StringList staleDirectories;
+	watchClock::time_point firstEvent;
+	watchClock::time_point lastEvent;
+	std::thread thread;
+
+	void record(string const & path, ChangeEvent::kind type) {
+		watchClock::time_point now = watchClock::now();
+		if (pending.empty()) {
+			firstEvent = now;
+		}
+		lastEvent = now;
+		std::map<string, ChangeEvent::kind>::iterator existing = pending.find(path);
+		if (existing == pending.end()) {
+			pending[path] = type;
+		} else if (!merge(existing->second, type)) {
+			pending.erase(existing);
+		}
+	}
+
+	void readEvents() {
+		char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+		std::lock_guard<std::mutex> guard(lock);
+		for (char * p = buffer; length > 0 && p < buffer + length; ) {
+			struct inotify_event const * event = (struct inotify_event const *) p;
+			p += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				for (std::map<int, directory>::const_iterator watched = directories.begin(); watched != directories.end(); ++watched) {
+					record(watched->second.virtualPath, ChangeEvent::RESCAN);
+					noteStale(watched->second.native);
+				}
+				continue;
+			}
+			std::map<int, directory>::iterator watched = directories.find(event->wd);
+			if (watched == directories.end()) {
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				directories.erase(watched);
+				continue;
+			}
+			if (event->len == 0) {
+				continue;
+			}
+			string native = watched->second.native + "/" + event->name;
+			string path = joinPath(watched->second.virtualPath, event->name);
+			if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+				record(path, ChangeEvent::ADDED);
+				if (event->mask & IN_ISDIR) {
+					// anything created before the watch was in place is only
+					// seen by scanning
+					addTree(native, path, true);
+				}
+			} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				if (event->mask & IN_ISDIR) {
+					removeTree(path);
+					noteStale(native);
+				}
+				record(path, ChangeEvent::REMOVED);
+			} else {
+				record(path, ChangeEvent::MODIFIED);
+			}
+		}
+	}
+
+	// remembers a native directory that mkdirs may wrongly think exists, if
+	// it is inside the write dir; callers hold lock
+	void noteStale(string const & native) {
+		char const * writeDir = PHYSFS_getWriteDir();
+		if (writeDir == NULL) {
+			return;
+		}
+		string root = writeDir;
+		while (root.size() > 1 && root[root.size() - 1] == '/') {
+			root.erase(root.size() - 1);
+		}
+		if (native == root) {
+			staleDirectories.push_back("");
+		} else if (native.size() > root.size() && native.compare(0, root.size(), root) == 0 && native[root.size()] == '/') {
+			staleDirectories.push_back(native.substr(root.size() + 1));
+		}
+	}
+
+	// stops watching a directory that moved away or was deleted
+	void removeTree(string const & virtualPath) {
+		std::map<int, directory>::iterator watched = directories.begin();
+		while (watched != directories.end()) {
+			if (isUnder(watched->second.virtualPath, virtualPath)) {
+				inotify_rm_watch(fd, watched->first);
+				directories.erase(watched++);
+			} else {
+				++watched;
+			}
+		}
+	}
+
+	// hands over pending events once they have settled; returns the poll
+	// timeout until the next check
+	int deliver() {
+		ChangeList changes;
+		StringList stale;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stale.swap(staleDirectories);
+			for (StringList::const_iterator dir = stale.begin(); dir != stale.end(); ++dir) {
+				forgetDirectories(*dir);
+			}
+			if (pending.empty()) {
+				return -1;
+			}
+			watchClock::time_point now = watchClock::now();
+			watchClock::time_point due = lastEvent + debounce;
+			if (now < due && now < firstEvent + debounce * maxDebouncePeriods) {
+				return std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+			}
+			for (std::map<string, ChangeEvent::kind>::const_iterator event = pending.begin(); event != pending.end(); ++event) {
+				ChangeEvent change = { event->first, event->second };
+				changes.push_back(change);
+			}
+			pending.clear();
+		}
+		callback(changes);
+		return -1;
+	}
+
+	void run() {
+		int timeout = -1;
+		for (;;) {
+			struct pollfd fds[2] = { { fd, POLLIN, 0 }, { wake, POLLIN, 0 } };
+			if (poll(fds, 2, timeout) < 0) {
+				continue;
+			}
+			if (fds[1].revents & POLLIN) {
+				return;
+			}
+			if (fds[0].revents & POLLIN) {
+				readEvents();
+			}
+			timeout = deliver();
+		}
+	}
+public:
+	Implementation(ChangeCallback const & callback, unsigned debounceMilliseconds)
+		: callback(callback), debounce(std::chrono::milliseconds(debounceMilliseconds)),
+		  fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), wake(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+		if (fd < 0 || wake < 0) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			if (wake >= 0) {
+				close(wake);
+			}
+			PHYSFSPP_THROW(std::runtime_error("could not start watching for changes"));
+		}
+		thread = std::thread(&Implementation::run, this);
+	}
+
+	~Implementation() {
+		uint64 one = 1;
+		ssize_t written = write(wake, &one, sizeof(one));
+		(void) written;
+		thread.join();
+		close(fd);
+		close(wake);
+	}
+
+	// watches native and every directory below it, recording everything in
+	// them as ADDED when reportContents is set; callers hold lock
+	std::size_t addTree(string const & native, string const & virtualPath, bool reportContents = false) {
+		int wd = inotify_add_watch(fd, native.c_str(), watchMask);
+		if (wd < 0) {
+			return 0;
+		}
+		directory watched = { native, virtualPath };
+		directories[wd] = watched;
+		std::size_t count = 1;
+		DIR * listing = opendir(native.c_str());
+		if (listing == NULL) {
+			return count;
+		}
+		while (struct dirent * entry = readdir(listing)) {
+			string name = entry->d_name;
+			if (name == "." || name == "..") {
+				continue;
+			}
+			string child = native + "/" + name;
+			if (reportContents) {
+				record(joinPath(virtualPath, name), ChangeEvent::ADDED);
+			}
+			if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && isNativeDirectory(child))) {
+				count += addTree(child, joinPath(virtualPath, name), reportContents);
+			}
+		}
+		closedir(listing);
+		return count;
+	}
+
+	std::size_t watch(string const & root) {
+		string normalized = normalizePath(root);
+		std::size_t count = 0;
+		StringList searchPath = getSearchPath();
+		std::lock_guard<std::mutex> guard(lock);
+		for (StringList::const_iterator dir = searchPath.begin(); dir != searchPath.end(); ++dir) {
+			if (!isNativeDirectory(*dir)) {
+				continue;
+			}
+			char const * mountPoint = PHYSFS_getMountPoint(dir->c_str());
+			string mounted = mountPoint != NULL ? normalizePath(mountPoint) : "";
+			if (isUnder(normalized, mounted)) {
+				string native = *dir;
+				if (normalized.size() > mounted.size()) {
+					native += "/" + normalized.substr(mounted.empty() ? 0 : mounted.size() + 1);
+				}
+				if (isNativeDirectory(native)) {
+					count += addTree(native, normalized);
+				}
+			} else if (isUnder(mounted, normalized)) {
+				count += addTree(*dir, mounted);
+			}
+		}
+		return count;
+	}
+};
+
+Watcher::Watcher(ChangeCallback callback, unsigned debounceMilliseconds)
+	: implementation(new Implementation(callback, debounceMilliseconds)) {}
+
+Watcher::~Watcher() {}
+
+std::size_t Watcher::watch(string const & root) {
+	return implementation->watch(root);
+}
+
+bool Watcher::isSupported() {
+	return true;
+}
+
+}
+
+#else
+
+namespace PhysFS {
+
+class Watcher::Implementation {};
+
+Watcher::Watcher(ChangeCallback, unsigned) {
+	PHYSFSPP_THROW(std::runtime_error("watching for changes is not supported on this platform"));
+}
+
+Watcher::~Watcher() {}
+
+std::size_t Watcher::watch(string const &) {
+	return 0;
+}
+
+bool Watcher::isSupported() {
+	return false;
+}
+
+}
+
+#endif
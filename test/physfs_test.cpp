@@ -1,4 +1,30 @@
 #include <physfs.hpp>
+#include <physfs_asset.hpp>
+#include <physfs_budget.hpp>
+#include <physfs_filter.hpp>
+#include <physfs_hash.hpp>
+#include <physfs_load.hpp>
+#include <physfs_memdir.hpp>
+#include <physfs_overlay.hpp>
+#include <physfs_reader.hpp>
+#include <physfs_registry.hpp>
+#include <physfs_search.hpp>
+#include <physfs_stream.hpp>
+#include <physfs_tree.hpp>
+#include <physfs_vfs.hpp>
+#include <physfs_watch.hpp>
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TestRunner.h>
 #include <cppunit/TestCaller.h>
@@ -7,11 +33,172 @@
 #include <cppunit/TestResult.h>
 #include <cppunit/TestRunner.h>
 
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeNative(fs::path const & path, std::string const & contents) {
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios_base::binary);
+    out.write(contents.data(), contents.size());
+}
+
+std::string readNative(fs::path const & path) {
+    std::ifstream in(path, std::ios_base::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// reads with istream::read, so a failing buffer leaves badbit behind
+std::string readStream(std::istream & in) {
+    std::string contents;
+    char block[1000];
+    while (in.read(block, sizeof(block)) || in.gcount() > 0) {
+        contents.append(block, in.gcount());
+    }
+    return contents;
+}
+
+std::string numbers(int count) {
+    std::string text;
+    for (int i = 0; i < count; i++) {
+        text += std::to_string(i) + ",";
+    }
+    return text;
+}
+
+bool waitFor(std::function<bool()> const & condition) {
+    for (int i = 0; i < 500; i++) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+struct UpperCase {
+    template <class Next>
+    void push(PhysFS::Chunk && chunk, Next & next) {
+        for (std::size_t i = 0; i < chunk.size(); i++) {
+            chunk.data()[i] = toupper(chunk.data()[i]);
+        }
+        next.push(std::move(chunk));
+    }
+
+    template <class Next>
+    void finish(Next &) {}
+};
+
+struct AssetItem {
+    PhysFS::uint32 id;
+    float weight;
+    PhysFS::AssetString name;
+};
+
+struct AssetTable {
+    PhysFS::uint32 version;
+    PhysFS::Array<AssetItem> items;
+    PhysFS::Offset<AssetItem> favourite;
+    PhysFS::AssetString title;
+};
+
+void checkTable(AssetTable const & table) {
+    CPPUNIT_ASSERT_EQUAL(PhysFS::uint32(7), table.version);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(3), table.items.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("sword"), std::string(table.items[0].name.view()));
+    CPPUNIT_ASSERT_EQUAL(std::string("shield"), std::string(table.items[1].name.view()));
+    // stored once however often it is added
+    CPPUNIT_ASSERT(table.items[0].name.c_str() == table.items[2].name.c_str());
+    CPPUNIT_ASSERT_EQUAL(PhysFS::uint32(2), table.favourite->id);
+    CPPUNIT_ASSERT_EQUAL(1.5f, table.favourite->weight);
+    CPPUNIT_ASSERT_EQUAL(std::string("weapons"), std::string(table.title.view()));
+}
+
+typedef std::set<std::tuple<std::string, PhysFS::uint64, std::size_t> > SearchHits;
+
+SearchHits bruteForceSearch(std::map<std::string, std::string> const & files, PhysFS::StringList const & patterns, bool ignoreCase) {
+    SearchHits hits;
+    for (std::map<std::string, std::string>::const_iterator file = files.begin(); file != files.end(); ++file) {
+        for (std::size_t p = 0; p < patterns.size(); p++) {
+            std::string text = file->second;
+            std::string pattern = patterns[p];
+            if (ignoreCase) {
+                for (std::size_t i = 0; i < text.size(); i++) {
+                    text[i] = tolower(text[i]);
+                }
+                for (std::size_t i = 0; i < pattern.size(); i++) {
+                    pattern[i] = tolower(pattern[i]);
+                }
+            }
+            for (std::size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1)) {
+                hits.insert(std::make_tuple(file->first, PhysFS::uint64(at), p));
+            }
+        }
+    }
+    return hits;
+}
+
+}
+
 class PhysfsTest : public CppUnit::TestFixture {
     CPPUNIT_TEST_SUITE(PhysfsTest);
     CPPUNIT_TEST(testExceptionThrownWhenFileNotFound);
+    CPPUNIT_TEST(testHashKnownValues);
+    CPPUNIT_TEST(testCompressRoundTrip);
+    CPPUNIT_TEST(testFilterPipeline);
+    CPPUNIT_TEST(testHashFileMatchesHasher);
+    CPPUNIT_TEST(testExtractTree);
+    CPPUNIT_TEST(testRemoveTreeWithoutMountedWriteDir);
+    CPPUNIT_TEST(testWatcherReportsFilesInNewDirectories);
+    CPPUNIT_TEST(testSnapshotDiff);
+    CPPUNIT_TEST(testRegistryReload);
+    CPPUNIT_TEST(testPeekAndConsume);
+    CPPUNIT_TEST(testLineReader);
+    CPPUNIT_TEST(testRecordReader);
+    CPPUNIT_TEST(testRemaining);
+    CPPUNIT_TEST(testReadAheadGrows);
+    CPPUNIT_TEST(testReadAllAlignment);
+    CPPUNIT_TEST(testLoadManyContiguous);
+    CPPUNIT_TEST(testResultApi);
+    CPPUNIT_TEST(testStringViews);
+    CPPUNIT_TEST(testVfsRefresh);
+    CPPUNIT_TEST(testOverlaySameLengthPatch);
+    CPPUNIT_TEST(testMemoryWriteDir);
+    CPPUNIT_TEST(testMemoryWriteDirOutlivedByStream);
+    CPPUNIT_TEST(testPolicyStreamPositions);
+    CPPUNIT_TEST(testSmallFile);
+    CPPUNIT_TEST(testSearchMatchesBruteForce);
+    CPPUNIT_TEST(testMemoryBudgetTrim);
+    CPPUNIT_TEST(testAssetRoundTrip);
     CPPUNIT_TEST_SUITE_END();
+private:
+    fs::path root;
+
+    std::string writeDir() const {
+        return (root / "write").string();
+    }
+
+    std::string dataDir() const {
+        return (root / "data").string();
+    }
 public:
+    void setUp() {
+        root = fs::temp_directory_path() / "physfs_test";
+        fs::remove_all(root);
+        fs::create_directories(writeDir());
+        fs::create_directories(dataDir());
+        PhysFS::init("physfs_test");
+        PhysFS::setWriteDir(writeDir());
+        PhysFS::mount(writeDir(), "/", true);
+    }
+
+    void tearDown() {
+        PhysFS::deinit();
+        fs::remove_all(root);
+    }
+
     void testExceptionThrownWhenFileNotFound() {
         try {
             PhysFS::ifstream file("the_princess_is_in_another_castle");
@@ -19,6 +206,641 @@ public:
         } catch (std::invalid_argument e) {
         }
     }
+
+    void testHashKnownValues() {
+        std::string check = "123456789";
+        PhysFS::Hasher crc32(PhysFS::CRC32);
+        crc32.update(check.data(), check.size());
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0xCBF43926), crc32.digest());
+        PhysFS::Hasher crc32c(PhysFS::CRC32C);
+        crc32c.update(check.data(), check.size());
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0xE3069283), crc32c.digest());
+        PhysFS::Hasher xxh64(PhysFS::XXH64);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0xEF46DB3751D8E999ULL), xxh64.digest());
+        xxh64.update("abc", 3);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0x44BC2CF5AD770999ULL), xxh64.digest());
+        std::string phrase = "Nobody inspects the spammish repetition";
+        xxh64.reset();
+        xxh64.update(phrase.data(), phrase.size());
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0xFBCEA83C8A378BF1ULL), xxh64.digest());
+    }
+
+    void testCompressRoundTrip() {
+        std::string data = numbers(30000);
+        std::vector<PhysFS::Compress> codecs(1, PhysFS::Compress::none());
+        if (PhysFS::Compress::isAvailable(PhysFS::Compress::ZSTD)) {
+            codecs.push_back(PhysFS::Compress::zstd());
+        }
+        if (PhysFS::Compress::isAvailable(PhysFS::Compress::LZ4)) {
+            codecs.push_back(PhysFS::Compress::lz4());
+        }
+        for (std::size_t i = 0; i < codecs.size(); i++) {
+            {
+                PhysFS::ofstream out("packed", PhysFS::WRITE, PhysFS::Compress(codecs[i]).frameSize(4096));
+                out << data;
+            }
+            for (unsigned threads = 1; threads <= 3; threads += 2) {
+                PhysFS::ifstream in("packed", PhysFS::Compress(codecs[i]).threads(threads));
+                CPPUNIT_ASSERT_EQUAL(data, readStream(in));
+                CPPUNIT_ASSERT(!in.bad());
+            }
+            // a truncated frame is an error, not the end of the file
+            fs::resize_file(root / "write" / "packed", fs::file_size(root / "write" / "packed") - 7);
+            PhysFS::ifstream in("packed", codecs[i]);
+            CPPUNIT_ASSERT(readStream(in).size() < data.size());
+            CPPUNIT_ASSERT(in.bad());
+        }
+    }
+
+    void testFilterPipeline() {
+        std::string data = numbers(20000) + "abc";
+        {
+            PhysFS::ofstream out("upper", PhysFS::WRITE, std::unique_ptr<PhysFS::Filter>(new PhysFS::StaticFilter<PhysFS::Pipeline<UpperCase> >()));
+            out << data;
+        }
+        std::string upper = data;
+        for (std::size_t i = 0; i < upper.size(); i++) {
+            upper[i] = toupper(upper[i]);
+        }
+        CPPUNIT_ASSERT_EQUAL(upper, readNative(root / "write" / "upper"));
+
+        {
+            PhysFS::FilterChain * chain = new PhysFS::FilterChain();
+            chain->add(PhysFS::compressFilter(PhysFS::Compress::none().frameSize(1000)));
+            PhysFS::ofstream out("framed", PhysFS::WRITE, std::unique_ptr<PhysFS::Filter>(chain));
+            out << data;
+        }
+        // stored raw, so each 1000-byte frame costs just its 12-byte header
+        std::uintmax_t frames = (data.size() + 999) / 1000;
+        CPPUNIT_ASSERT_EQUAL(std::uintmax_t(data.size() + 12 * frames), fs::file_size(root / "write" / "framed"));
+        {
+            PhysFS::ifstream in("framed", PhysFS::decompressFilter());
+            CPPUNIT_ASSERT_EQUAL(data, readStream(in));
+            CPPUNIT_ASSERT(!in.bad());
+        }
+
+        // a frame cut short at the end is an error, not the end of the data
+        fs::resize_file(root / "write" / "framed", fs::file_size(root / "write" / "framed") - 7);
+        PhysFS::ifstream in("framed", PhysFS::decompressFilter());
+        CPPUNIT_ASSERT(readStream(in).size() < data.size());
+        CPPUNIT_ASSERT(in.bad());
+    }
+
+    void testHashFileMatchesHasher() {
+        std::string data = numbers(100000);
+        writeNative(root / "write" / "tree" / "a", data);
+        writeNative(root / "write" / "tree" / "sub" / "b", "b");
+        PhysFS::Hasher hasher(PhysFS::XXH64);
+        hasher.update(data.data(), data.size());
+        CPPUNIT_ASSERT_EQUAL(hasher.digest(), PhysFS::hashFile("tree/a", PhysFS::XXH64));
+
+        PhysFS::FileHashList hashes = PhysFS::hashTree("tree", PhysFS::XXH64, 2);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(2), hashes.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("tree/a"), hashes[0].path);
+        CPPUNIT_ASSERT_EQUAL(hasher.digest(), hashes[0].hash);
+        CPPUNIT_ASSERT_EQUAL(std::string("tree/sub/b"), hashes[1].path);
+        CPPUNIT_ASSERT_THROW(PhysFS::hashFile("missing", PhysFS::XXH64), std::invalid_argument);
+    }
+
+    void testExtractTree() {
+        std::string data = numbers(50000);
+        writeNative(root / "data" / "a" / "b" / "big", data);
+        writeNative(root / "data" / "c", "small");
+        writeNative(root / "data" / "empty", "");
+        PhysFS::mount(dataDir(), "/data", true);
+
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(data.size()), PhysFS::copy("data/a/b/big", "copied"));
+        CPPUNIT_ASSERT_EQUAL(data, readNative(root / "write" / "copied"));
+
+        PhysFS::uint64 filesDone = 0;
+        PhysFS::uint64 bytes = PhysFS::extractTree("data", "out", [&](PhysFS::CopyProgress const & progress) {
+            filesDone = progress.filesDone;
+        }, 2);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(data.size() + 5), bytes);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(3), filesDone);
+        CPPUNIT_ASSERT_EQUAL(data, readNative(root / "write" / "out" / "a" / "b" / "big"));
+        CPPUNIT_ASSERT(fs::exists(root / "write" / "out" / "empty"));
+    }
+
+    void testRemoveTreeWithoutMountedWriteDir() {
+        writeNative(root / "write" / "a" / "x", "x");
+        writeNative(root / "write" / "a" / "b" / "y", "y");
+        writeNative(root / "write" / "a" / "b" / "c" / "z", "z");
+        writeNative(root / "write" / "keep", "keep");
+        // nothing below the write dir is on the search path
+        PhysFS::removeFromSearchPath(writeDir());
+
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(6), PhysFS::removeTree("a", 2));
+        CPPUNIT_ASSERT(!fs::exists(root / "write" / "a"));
+        CPPUNIT_ASSERT(fs::exists(root / "write" / "keep"));
+        CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(0), PhysFS::removeTree("a"));
+
+        // removeTree forgot a, and below the known a/b only c and d are new
+        CPPUNIT_ASSERT(PhysFS::mkdirs("a/b"));
+        CPPUNIT_ASSERT(PhysFS::mkdirs("a/b/c/d"));
+        CPPUNIT_ASSERT(fs::is_directory(root / "write" / "a" / "b" / "c" / "d"));
+    }
+
+    void testWatcherReportsFilesInNewDirectories() {
+        if (!PhysFS::Watcher::isSupported()) {
+            return;
+        }
+        PhysFS::removeFromSearchPath(writeDir());
+        PhysFS::mount(writeDir(), "/game", true);
+        std::mutex lock;
+        std::set<std::string> added;
+        std::set<std::string> removed;
+        PhysFS::Watcher watcher([&](PhysFS::ChangeList const & changes) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (std::size_t i = 0; i < changes.size(); i++) {
+                if (changes[i].type == PhysFS::ChangeEvent::ADDED) {
+                    added.insert(changes[i].path);
+                } else if (changes[i].type == PhysFS::ChangeEvent::REMOVED) {
+                    removed.insert(changes[i].path);
+                }
+            }
+        }, 20);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(1), watcher.watch("/game"));
+
+        CPPUNIT_ASSERT(PhysFS::mkdirs("sub/deep"));
+        // created in one go, before a watch on the new directories can exist
+        fs::create_directories(root / "write" / "burst" / "a" / "b");
+        writeNative(root / "write" / "burst" / "a" / "b" / "f", "f");
+        CPPUNIT_ASSERT(waitFor([&] {
+            std::lock_guard<std::mutex> guard(lock);
+            return added.count("game/burst/a/b/f") != 0 && added.count("game/sub/deep") != 0;
+        }));
+
+        // mkdirs must forget sub once it is gone, even though it is mounted
+        // under /game
+        fs::remove_all(root / "write" / "sub");
+        CPPUNIT_ASSERT(waitFor([&] {
+            std::lock_guard<std::mutex> guard(lock);
+            return removed.count("game/sub") != 0;
+        }));
+        CPPUNIT_ASSERT(PhysFS::mkdirs("sub/deep"));
+        CPPUNIT_ASSERT(fs::is_directory(root / "write" / "sub" / "deep"));
+    }
+
+    void testSnapshotDiff() {
+        writeNative(root / "write" / "d" / "changed", "1");
+        writeNative(root / "write" / "d" / "removed", "2");
+        writeNative(root / "write" / "d" / "same", "3");
+        PhysFS::Snapshot before = PhysFS::snapshot("d", 2);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(3), before.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("d/changed"), before.entry(0).path);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::sint64(1), before.entry(0).size);
+
+        writeNative(root / "write" / "d" / "changed", "11");
+        fs::remove(root / "write" / "d" / "removed");
+        writeNative(root / "write" / "d" / "added", "4");
+        PhysFS::ChangeList changes = PhysFS::diff(before, PhysFS::snapshot("d"));
+        std::map<std::string, PhysFS::ChangeEvent::kind> kinds;
+        for (std::size_t i = 0; i < changes.size(); i++) {
+            kinds[changes[i].path] = changes[i].type;
+        }
+        CPPUNIT_ASSERT_EQUAL(std::size_t(3), kinds.size());
+        CPPUNIT_ASSERT(kinds["d/changed"] == PhysFS::ChangeEvent::MODIFIED);
+        CPPUNIT_ASSERT(kinds["d/removed"] == PhysFS::ChangeEvent::REMOVED);
+        CPPUNIT_ASSERT(kinds["d/added"] == PhysFS::ChangeEvent::ADDED);
+        CPPUNIT_ASSERT(PhysFS::diff(before, before).empty());
+    }
+
+    void testRegistryReload() {
+        writeNative(root / "write" / "a" / "x", "hello");
+        PhysFS::Registry registry;
+        PhysFS::Resource first = registry.load("a/x");
+        PhysFS::Resource second = registry.load("/a/x");
+        CPPUNIT_ASSERT(first.get() == second.get());
+        CPPUNIT_ASSERT_EQUAL(std::size_t(1), registry.size());
+        PhysFS::Content old = first.get();
+
+        writeNative(root / "write" / "a" / "x", "bye");
+        PhysFS::ChangeEvent change = { "a", PhysFS::ChangeEvent::RESCAN };
+        registry.onChange(PhysFS::ChangeList(1, change));
+        CPPUNIT_ASSERT_EQUAL(std::string("bye"), *second.get());
+        CPPUNIT_ASSERT_EQUAL(std::string("hello"), *old);
+        CPPUNIT_ASSERT_THROW(registry.load("missing"), std::invalid_argument);
+    }
+
+    void testPeekAndConsume() {
+        std::string data = numbers(10000);
+        writeNative(root / "write" / "plain", data);
+        PhysFS::ifstream in("plain");
+        std::string_view ahead = in.peek(5000);
+        CPPUNIT_ASSERT_EQUAL(data.substr(0, 5000), std::string(ahead));
+        in.consume(10);
+        CPPUNIT_ASSERT_EQUAL(std::char_traits<char>::to_int_type(data[10]), in.peek());
+        std::string rest = data.substr(0, 10);
+        for (;;) {
+            std::string_view next = in.peek(3333);
+            if (next.empty()) {
+                break;
+            }
+            rest.append(next.data(), next.size());
+            in.consume(next.size());
+        }
+        CPPUNIT_ASSERT_EQUAL(data, rest);
+        CPPUNIT_ASSERT(in.contiguous().empty());
+    }
+
+    void testLineReader() {
+        std::string data;
+        std::vector<std::string> lines;
+        for (int i = 0; i < 500; i++) {
+            lines.push_back(std::string((i * 7) % 3000, 'a' + i % 26));
+            data += lines.back() + "\n";
+        }
+        lines.push_back("last");
+        data += "last";
+        writeNative(root / "write" / "lines", data);
+        PhysFS::ifstream in("lines");
+        PhysFS::LineReader reader(in);
+        std::string_view line;
+        std::size_t count = 0;
+        while (reader.next(line)) {
+            CPPUNIT_ASSERT(count < lines.size());
+            CPPUNIT_ASSERT_EQUAL(lines[count], std::string(line));
+            count++;
+            CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(count), reader.lineNumber());
+        }
+        CPPUNIT_ASSERT_EQUAL(lines.size(), count);
+    }
+
+    void testRecordReader() {
+        std::vector<std::string> records;
+        std::string data;
+        for (int i = 0; i < 200; i++) {
+            records.push_back(std::string((i * 131) % 10000, 'a' + i % 26));
+            PhysFS::uint32 length = records.back().size();
+            for (int b = 3; b >= 0; b--) {
+                data += char(length >> (8 * b));
+            }
+            data += records.back();
+        }
+        writeNative(root / "write" / "records", data);
+        writeNative(root / "write" / "truncated", data.substr(0, data.size() - 3));
+        std::string_view record;
+        {
+            PhysFS::ifstream in("records");
+            PhysFS::RecordReader<PhysFS::uint32, PhysFS::BIG_ENDIAN_ORDER> reader(in, 4096);
+            std::size_t count = 0;
+            while (reader.next(record)) {
+                CPPUNIT_ASSERT_EQUAL(records[count], std::string(record));
+                count++;
+            }
+            CPPUNIT_ASSERT_EQUAL(records.size(), count);
+        }
+        PhysFS::ifstream in("truncated");
+        PhysFS::RecordReader<PhysFS::uint32, PhysFS::BIG_ENDIAN_ORDER> reader(in);
+        CPPUNIT_ASSERT_THROW(while (reader.next(record)) {}, std::runtime_error);
+    }
+
+    void testRemaining() {
+        writeNative(root / "write" / "plain", std::string(5000, 'x'));
+        PhysFS::ifstream in("plain");
+        CPPUNIT_ASSERT_EQUAL(PhysFS::sint64(5000), in.remaining());
+        CPPUNIT_ASSERT_EQUAL(std::streamsize(5000), in.rdbuf()->in_avail());
+        char block[100];
+        in.read(block, sizeof(block));
+        CPPUNIT_ASSERT_EQUAL(PhysFS::sint64(4900), in.remaining());
+        in.seekg(4000);
+        CPPUNIT_ASSERT_EQUAL(std::streamsize(1000), in.rdbuf()->in_avail());
+        in.seekg(5000);
+        CPPUNIT_ASSERT_EQUAL(PhysFS::sint64(0), in.remaining());
+        CPPUNIT_ASSERT_EQUAL(std::streamsize(-1), in.rdbuf()->in_avail());
+    }
+
+    void testReadAheadGrows() {
+        std::string data = numbers(200000);
+        writeNative(root / "write" / "big", data);
+        PhysFS::ifstream in("big");
+        std::string got;
+        std::size_t largest = 0;
+        char c;
+        while (in.get(c)) {
+            got += c;
+            largest = std::max(largest, in.contiguous().size());
+        }
+        CPPUNIT_ASSERT_EQUAL(data, got);
+        CPPUNIT_ASSERT(largest > 100000);
+        in.clear();
+        in.seekg(500000);
+        CPPUNIT_ASSERT_EQUAL(data.substr(500000, 2048), std::string(in.contiguous()));
+    }
+
+    void testReadAllAlignment() {
+        std::string data = numbers(10000);
+        writeNative(root / "write" / "plain", data);
+        PhysFS::Buffer all = PhysFS::readAll("plain", PhysFS::ReadOptions().alignment(64).padding(16));
+        CPPUNIT_ASSERT_EQUAL(data, std::string(all.view()));
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), reinterpret_cast<std::size_t>(all.data()) % 64);
+        for (std::size_t i = 0; i < 16; i++) {
+            CPPUNIT_ASSERT_EQUAL('\0', all.data()[all.size() + i]);
+        }
+        PhysFS::Buffer range = PhysFS::readRange("plain", 1000, 500, PhysFS::ReadOptions().alignment(4096));
+        CPPUNIT_ASSERT_EQUAL(data.substr(1000, 500), std::string(range.view()));
+        CPPUNIT_ASSERT(PhysFS::readRange("plain", data.size() + 10, 500).empty());
+        CPPUNIT_ASSERT_THROW(PhysFS::ReadOptions().alignment(48), std::invalid_argument);
+    }
+
+    void testLoadManyContiguous() {
+        PhysFS::StringList paths;
+        std::vector<std::string> contents;
+        for (int i = 0; i < 50; i++) {
+            paths.push_back("f" + std::to_string(i));
+            contents.push_back(std::string(i % 7 == 0 ? 0 : i * 30, 'a' + i % 26));
+            writeNative(root / "write" / paths.back(), contents.back());
+        }
+        PhysFS::LoadedFiles loaded = PhysFS::loadManyContiguous(paths, PhysFS::ReadOptions().alignment(64), 2);
+        CPPUNIT_ASSERT_EQUAL(paths.size(), loaded.files.size());
+        for (std::size_t i = 0; i < paths.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL(paths[i], loaded.files[i].path);
+            CPPUNIT_ASSERT_EQUAL(contents[i], std::string(loaded.files[i].contents));
+            CPPUNIT_ASSERT_EQUAL(std::size_t(0), reinterpret_cast<std::size_t>(loaded.files[i].contents.data()) % 64);
+        }
+        paths.push_back("missing");
+        CPPUNIT_ASSERT_THROW(PhysFS::loadManyContiguous(paths), std::invalid_argument);
+    }
+
+    void testResultApi() {
+        PhysFS::Result<void> failed = PhysFS::tryMount((root / "missing").string(), "/", true);
+        CPPUNIT_ASSERT(!failed);
+        CPPUNIT_ASSERT(!failed.error().getMessage().empty());
+        {
+            PhysFS::Result<std::unique_ptr<PhysFS::ofstream> > out = PhysFS::ofstream::open("a");
+            CPPUNIT_ASSERT(out.ok());
+            **out << "hello";
+        }
+        PhysFS::Result<std::unique_ptr<PhysFS::ifstream> > in = PhysFS::ifstream::open("a");
+        CPPUNIT_ASSERT(in.ok());
+        std::string word;
+        **in >> word;
+        CPPUNIT_ASSERT_EQUAL(std::string("hello"), word);
+        CPPUNIT_ASSERT(!PhysFS::ifstream::open("missing"));
+        CPPUNIT_ASSERT_EQUAL(writeDir(), PhysFS::tryGetRealDir("a").value());
+        CPPUNIT_ASSERT(!PhysFS::tryGetRealDir("missing"));
+    }
+
+    void testStringViews() {
+        CPPUNIT_ASSERT_EQUAL(writeDir(), std::string(PhysFS::getWriteDirView()));
+        std::shared_ptr<PhysFS::ConfigDirs const> before = PhysFS::getConfigDirs();
+        CPPUNIT_ASSERT_EQUAL(writeDir(), before->writeDir);
+        CPPUNIT_ASSERT(PhysFS::getConfigDirs() == before);
+        PhysFS::setWriteDir(dataDir());
+        CPPUNIT_ASSERT_EQUAL(dataDir(), PhysFS::getConfigDirs()->writeDir);
+        CPPUNIT_ASSERT_EQUAL(writeDir(), before->writeDir);
+        writeNative(root / "write" / "y", "y");
+        CPPUNIT_ASSERT_EQUAL(writeDir(), std::string(PhysFS::getRealDirView("y")));
+        CPPUNIT_ASSERT(PhysFS::getRealDirView("missing").empty());
+    }
+
+    void testVfsRefresh() {
+        writeNative(root / "data" / "a" / "x", "one");
+        PhysFS::Vfs vfs;
+        CPPUNIT_ASSERT(vfs.mount(dataDir(), "/", true));
+        CPPUNIT_ASSERT(vfs.exists("a/x"));
+        CPPUNIT_ASSERT(vfs.isDirectory("a"));
+        CPPUNIT_ASSERT_EQUAL(dataDir(), vfs.getRealDir("a/x"));
+
+        writeNative(root / "data" / "a" / "fresh", "new");
+        CPPUNIT_ASSERT(!vfs.exists("a/fresh"));
+        vfs.refresh();
+        CPPUNIT_ASSERT(vfs.exists("a/fresh"));
+        std::string word;
+        *vfs.openRead("a/fresh") >> word;
+        CPPUNIT_ASSERT_EQUAL(std::string("new"), word);
+        CPPUNIT_ASSERT_THROW(vfs.openRead("a/missing"), std::invalid_argument);
+    }
+
+    void testOverlaySameLengthPatch() {
+        std::string data = numbers(50000);
+        writeNative(root / "data" / "d" / "big", data);
+        PhysFS::removeFromSearchPath(writeDir());
+        PhysFS::mount(dataDir(), "/", true);
+        PhysFS::Overlay overlay(".overlay", 4096);
+        {
+            // leaves the length unchanged, so only chunks are written
+            std::unique_ptr<std::iostream> update = overlay.openUpdate("d/big");
+            update->seekp(10000);
+            *update << "PATCH";
+        }
+        CPPUNIT_ASSERT(overlay.isShadowed("d/big"));
+        std::string patched = data;
+        patched.replace(10000, 5, "PATCH");
+        CPPUNIT_ASSERT_EQUAL(patched, readStream(*overlay.openRead("d/big")));
+        CPPUNIT_ASSERT_EQUAL(data, readNative(root / "data" / "d" / "big"));
+
+        overlay.discard("d/big");
+        CPPUNIT_ASSERT(!overlay.isShadowed("d/big"));
+        CPPUNIT_ASSERT(!fs::exists(root / "write" / ".overlay" / "d" / "big.chunks"));
+        CPPUNIT_ASSERT_EQUAL(data, readStream(*overlay.openRead("d/big")));
+    }
+
+    void testMemoryWriteDir() {
+        PhysFS::MemoryWriteDir memory(1 << 20, 0);
+        {
+            std::unique_ptr<std::ostream> out = memory.openWrite("d/a");
+            *out << "hello" << std::endl;
+            // flushing the stream does not publish it
+            CPPUNIT_ASSERT(!memory.exists("d/a"));
+        }
+        CPPUNIT_ASSERT(memory.exists("d/a"));
+        CPPUNIT_ASSERT(!fs::exists(root / "write" / "d" / "a"));
+        {
+            std::unique_ptr<std::ostream> out = memory.openWrite("d/a", PhysFS::APPEND);
+            *out << "world";
+        }
+        CPPUNIT_ASSERT_EQUAL(std::size_t(11), memory.pendingBytes());
+        CPPUNIT_ASSERT(memory.flush());
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), memory.pendingBytes());
+        CPPUNIT_ASSERT_EQUAL(std::string("hello\nworld"), readNative(root / "write" / "d" / "a"));
+
+        memory.deleteFile("d/a");
+        CPPUNIT_ASSERT(!memory.exists("d/a"));
+        CPPUNIT_ASSERT_THROW(memory.openRead("d/a"), std::invalid_argument);
+        CPPUNIT_ASSERT(memory.flush());
+        CPPUNIT_ASSERT(!fs::exists(root / "write" / "d" / "a"));
+
+        // a delete that fails stays pending until it goes through
+        writeNative(root / "write" / "full" / "x", "x");
+        memory.deleteFile("full");
+        CPPUNIT_ASSERT(!memory.flush());
+        fs::remove(root / "write" / "full" / "x");
+        CPPUNIT_ASSERT(memory.flush());
+        CPPUNIT_ASSERT(!fs::exists(root / "write" / "full"));
+    }
+
+    void testMemoryWriteDirOutlivedByStream() {
+        std::unique_ptr<std::ostream> out;
+        {
+            PhysFS::MemoryWriteDir memory(1 << 20, 0);
+            out = memory.openWrite("late");
+            *out << "late";
+        }
+        out.reset();
+        CPPUNIT_ASSERT_EQUAL(std::string("late"), readNative(root / "write" / "late"));
+    }
+
+    void testPolicyStreamPositions() {
+        std::string data = numbers(20000);
+        writeNative(root / "write" / "big", data);
+        {
+            // asking for the position must keep the read in flight
+            PhysFS::basic_ifstream<PhysFS::HeapBuffer<1024>, PhysFS::PooledAllocation, PhysFS::AsyncRefill> in("big");
+            char c;
+            for (int i = 0; i < 5000; i++) {
+                CPPUNIT_ASSERT_EQUAL(std::streamoff(i), std::streamoff(in.tellg()));
+                in.get(c);
+                CPPUNIT_ASSERT_EQUAL(data[i], c);
+            }
+            in.seekg(30000);
+            char block[10];
+            in.read(block, sizeof(block));
+            CPPUNIT_ASSERT_EQUAL(data.substr(30000, 10), std::string(block, sizeof(block)));
+            CPPUNIT_ASSERT_EQUAL(std::streamoff(30010), std::streamoff(in.tellg()));
+        }
+        {
+            PhysFS::basic_ifstream<PhysFS::InlineBuffer<100> > in("big");
+            CPPUNIT_ASSERT_EQUAL(data, readStream(in));
+        }
+        {
+            PhysFS::basic_ofstream<PhysFS::InlineBuffer<64> > out("written");
+            for (int i = 0; i < 300; i++) {
+                CPPUNIT_ASSERT_EQUAL(std::streamoff(i), std::streamoff(out.tellp()));
+                out << 'a';
+            }
+        }
+        CPPUNIT_ASSERT_EQUAL(std::string(300, 'a'), readNative(root / "write" / "written"));
+    }
+
+    void testSmallFile() {
+        std::string data = numbers(5000);
+        writeNative(root / "write" / "small", data.substr(0, 3000));
+        writeNative(root / "write" / "big", data);
+        {
+            PhysFS::small_ifstream<> in("small");
+            CPPUNIT_ASSERT_EQUAL(data.substr(0, 3000), readStream(in));
+        }
+        PhysFS::SmallFile<> small("small");
+        CPPUNIT_ASSERT(small.isInline());
+        CPPUNIT_ASSERT_EQUAL(data.substr(0, 3000), std::string(small.view()));
+        PhysFS::SmallFile<> big("big");
+        CPPUNIT_ASSERT(!big.isInline());
+        CPPUNIT_ASSERT_EQUAL(data, std::string(big.view()));
+        CPPUNIT_ASSERT_THROW(PhysFS::SmallFile<> missing("missing"), std::invalid_argument);
+    }
+
+    void testSearchMatchesBruteForce() {
+        std::map<std::string, std::string> files;
+        srand(7);
+        for (int i = 0; i < 12; i++) {
+            std::string text;
+            int length = rand() % 5000;
+            for (int j = 0; j < length; j++) {
+                text += "abAB xy"[rand() % 7];
+            }
+            std::string name = (i % 3 == 0 ? "a/b/f" : i % 3 == 1 ? "a/f" : "f") + std::to_string(i);
+            files[name] = text;
+            writeNative(root / "data" / name, text);
+        }
+        PhysFS::removeFromSearchPath(writeDir());
+        PhysFS::mount(dataDir(), "/", true);
+
+        std::vector<PhysFS::StringList> patternSets;
+        patternSets.push_back(PhysFS::StringList(1, "abab"));
+        patternSets.push_back(PhysFS::StringList(1, "a"));
+        patternSets.push_back(PhysFS::StringList{"ab", "bab", "xy", "b"});
+        patternSets.push_back(PhysFS::StringList{"aaaa", "aa"});
+        std::size_t const blockSizes[] = {1, 3, 64, 1 << 20};
+        std::mutex lock;
+        for (std::size_t block : blockSizes) {
+            for (std::size_t set = 0; set < patternSets.size(); set++) {
+                for (int ignoreCase = 0; ignoreCase < 2; ignoreCase++) {
+                    PhysFS::StringList const & patterns = patternSets[set];
+                    SearchHits hits;
+                    PhysFS::MatchCallback collect = [&](PhysFS::SearchMatch const & match) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        CPPUNIT_ASSERT(hits.insert(std::make_tuple(match.path, match.offset, match.pattern)).second);
+                        return true;
+                    };
+                    PhysFS::SearchOptions options = PhysFS::SearchOptions().blockSize(block).ignoreCase(ignoreCase != 0).threads(3);
+                    PhysFS::uint64 reported = patterns.size() == 1
+                        ? PhysFS::search("/", patterns[0], collect, options)
+                        : PhysFS::search("/", patterns, collect, options);
+                    SearchHits expected = bruteForceSearch(files, patterns, ignoreCase != 0);
+                    CPPUNIT_ASSERT(hits == expected);
+                    CPPUNIT_ASSERT_EQUAL(PhysFS::uint64(expected.size()), reported);
+                }
+            }
+        }
+        CPPUNIT_ASSERT_THROW(PhysFS::search("/", "", [](PhysFS::SearchMatch const &) { return true; }), std::invalid_argument);
+    }
+
+    void testMemoryBudgetTrim() {
+        PhysFS::MemoryBudget budget;
+        std::vector<int> order;
+        std::size_t dear = 1000;
+        std::size_t cheap = 500;
+        auto shrinker = [&order](std::size_t & held, int cost) {
+            return [&order, &held, cost](std::size_t target) {
+                order.push_back(cost);
+                std::size_t released = held > target ? held - target : 0;
+                held -= released;
+                return released;
+            };
+        };
+        PhysFS::uint64 dearId = budget.add(5, [&] { return dear; }, shrinker(dear, 5));
+        budget.add(1, [&] { return cheap; }, shrinker(cheap, 1));
+        CPPUNIT_ASSERT_EQUAL(std::size_t(1500), budget.usage());
+
+        CPPUNIT_ASSERT_EQUAL(std::size_t(300), budget.trim(1200));
+        CPPUNIT_ASSERT_EQUAL(std::size_t(200), cheap);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(1000), dear);
+        CPPUNIT_ASSERT(order == std::vector<int>(1, 1));
+
+        CPPUNIT_ASSERT_EQUAL(std::size_t(1100), budget.trim(100));
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), cheap);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(100), dear);
+        budget.remove(dearId);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), budget.usage());
+    }
+
+    void testAssetRoundTrip() {
+        PhysFS::AssetBuilder builder;
+        AssetItem items[3] = {{1, 0.5f, {}}, {2, 1.5f, {}}, {3, 2.5f, {}}};
+        PhysFS::uint64 itemsAt = builder.addArray(items, 3);
+        char const * names[3] = {"sword", "shield", "sword"};
+        for (int i = 0; i < 3; i++) {
+            builder.link(itemsAt + i * sizeof(AssetItem), &AssetItem::name, names[i]);
+        }
+        AssetTable table = {};
+        table.version = 7;
+        PhysFS::uint64 tableAt = builder.add(table);
+        builder.link(tableAt, &AssetTable::items, itemsAt, 3);
+        builder.link(tableAt, &AssetTable::favourite, itemsAt + sizeof(AssetItem));
+        builder.link(tableAt, &AssetTable::title, "weapons");
+        builder.setRoot<AssetTable>(tableAt);
+        builder.write("table.asset");
+
+        {
+            PhysFS::AssetFile mapped("table.asset");
+#ifdef __unix__
+            CPPUNIT_ASSERT(mapped.getBacking() == PhysFS::AssetFile::MAPPED);
+#endif
+            checkTable(mapped.root<AssetTable>());
+            CPPUNIT_ASSERT_THROW(mapped.root<AssetItem>(), std::invalid_argument);
+        }
+        {
+            PhysFS::AssetFile loaded("table.asset", PhysFS::AssetFile::LOADED);
+            CPPUNIT_ASSERT(loaded.getBacking() == PhysFS::AssetFile::LOADED);
+            checkTable(loaded.root<AssetTable>());
+        }
+        std::vector<char> const & bytes = builder.finish();
+        writeNative(root / "write" / "cut.asset", std::string(bytes.data(), bytes.size() - 1));
+        CPPUNIT_ASSERT_THROW(PhysFS::AssetFile("cut.asset"), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(PhysFS::AssetFile("missing.asset"), std::invalid_argument);
+    }
 };
 
 